@@ -0,0 +1,48 @@
+#ifndef CTRD_AIG
+#define CTRD_AIG
+
+#include "ctrd_prop.h"
+
+#include <unordered_map>
+
+// Literal = node * 2 + complement. Node 0 is constant false.
+typedef uint32_t AigLit;
+#define AIG_FALSE 0u
+#define AIG_TRUE 1u
+#define AIG_INPUT 0xffffffffu  // fanin of input nodes
+
+inline AigLit aig_not(AigLit a) { return a ^ 1; }
+inline uint32_t aig_node(AigLit a) { return a >> 1; }
+
+
+struct AigStats {
+  long requested = 0;  // AND gates asked for
+  long folded = 0;     // answered by constants and rewrites
+  long hashed = 0;     // found in the strash table
+  long nodes = 0;      // AND nodes built
+  int queries = 0;
+
+  void add(const AigStats &other);
+  void log_summary() const;
+};
+
+
+// Structurally hashed and-inverter graph. Fanins live in two arrays
+// indexed by node; inputs have AIG_INPUT fanins.
+struct Aig {
+  std::vector<AigLit> fanin0;
+  std::vector<AigLit> fanin1;
+  std::unordered_map<uint64_t, uint32_t> strash;
+  AigStats stats;
+
+  Aig();
+  int num_nodes() const { return fanin0.size(); }
+  bool is_input(uint32_t node) const { return node > 0 && fanin0[node] == AIG_INPUT; }
+  AigLit input();
+  AigLit and_lit(AigLit a, AigLit b);
+  AigLit or_lit(AigLit a, AigLit b) { return aig_not(and_lit(aig_not(a), aig_not(b))); }
+  AigLit xor_lit(AigLit a, AigLit b) { return or_lit(and_lit(a, aig_not(b)), and_lit(aig_not(a), b)); }
+  AigLit ite_lit(AigLit s, AigLit a, AigLit b) { return or_lit(and_lit(s, a), and_lit(aig_not(s), b)); }
+};
+
+#endif
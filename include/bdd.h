@@ -0,0 +1,82 @@
+#ifndef CTRD_BDD
+#define CTRD_BDD
+
+#include "ctrd_prop.h"
+#include "bit_solver.h"
+
+#include <unordered_map>
+
+// Candidates whose cone reads at most this many bits are decided on BDDs.
+#define BDD_MAX_SUPPORT 20
+#define BDD_MAX_NODES (1 << 22)
+#define BDD_GC_NODES (1 << 18)
+#define BDD_CACHE_BITS 16
+
+#define BDD_FALSE 0u
+#define BDD_TRUE 1u
+
+
+struct BddStats {
+  int candidates = 0;
+  int decided = 0;
+  int overflows = 0;
+  int collections = 0;
+  long freed = 0;
+  long peakNodes = 0;
+
+  void add(const BddStats &other);
+  void log_summary() const;
+};
+
+
+// Reduced ordered BDD package without complement edges. Nodes live in
+// three parallel arrays and are never moved; collect() returns the
+// nodes no root reaches to a free list. Variables are ordered by
+// creation.
+struct Bdd {
+  enum Op : uint32_t { OP_AND, OP_OR, OP_XOR };
+  struct CacheEntry {
+    uint32_t op, a, b, result;
+  };
+
+  std::vector<uint32_t> var;
+  std::vector<uint32_t> lo;
+  std::vector<uint32_t> hi;
+  std::unordered_map<uint64_t, std::vector<uint32_t>> unique;
+  std::vector<CacheEntry> cache;
+  std::vector<uint32_t> freeList;
+  uint32_t numVars = 0;
+  long live = 2;
+  bool overflow = false;
+  BddStats &stats;
+
+  explicit Bdd(BddStats &stats);
+  uint32_t new_var();
+  uint32_t make(uint32_t v, uint32_t l, uint32_t h);
+  uint32_t apply(Op op, uint32_t a, uint32_t b);
+  void collect(const std::vector<uint32_t> &roots);
+};
+
+
+// BitSolver view of a Bdd: literals are nodes and the assertions are
+// kept as one conjunction. Once the node limit is hit every query
+// answers satisfiable.
+struct BddBitSolver : public BitSolver {
+  Bdd bdd;
+  uint32_t constraint = BDD_TRUE;
+
+  explicit BddBitSolver(BddStats &stats) : bdd(stats) { }
+  int lit_const(bool value) override { return value ? BDD_TRUE : BDD_FALSE; }
+  int lit_new() override { return bdd.new_var(); }
+  int lit_not(int a) override { return bdd.apply(Bdd::OP_XOR, a, BDD_TRUE); }
+  int lit_and(int a, int b) override { return bdd.apply(Bdd::OP_AND, a, b); }
+  int lit_or(int a, int b) override { return bdd.apply(Bdd::OP_OR, a, b); }
+  int lit_xor(int a, int b) override { return bdd.apply(Bdd::OP_XOR, a, b); }
+  int lit_iff(int a, int b) override { return lit_not(lit_xor(a, b)); }
+  int lit_ite(int sel, int a, int b) override { return lit_or(lit_and(sel, a), lit_and(lit_not(sel), b)); }
+  void add(int a) override { constraint = bdd.apply(Bdd::OP_AND, constraint, a); }
+  bool satisfiable(int assumption) override;
+  void collect(const std::vector<int> &roots);
+};
+
+#endif
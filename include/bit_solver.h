@@ -0,0 +1,43 @@
+#ifndef CTRD_BIT_SOLVER
+#define CTRD_BIT_SOLVER
+
+#include "ctrd_prop.h"
+#include "aig.h"
+
+#include <memory>
+
+// Incremental Boolean solver behind the bit-level encoders. Literals are
+// plain ints that only mean something to the solver that made them.
+struct BitSolver {
+  int unknowns = 0;  // checks stopped by a limit
+
+  virtual ~BitSolver() { }
+  virtual int lit_const(bool value) = 0;
+  virtual int lit_new() = 0;
+  virtual int lit_not(int a) = 0;
+  virtual int lit_and(int a, int b) = 0;
+  virtual int lit_or(int a, int b) = 0;
+  virtual int lit_xor(int a, int b) = 0;
+  virtual int lit_iff(int a, int b) = 0;
+  virtual int lit_ite(int s, int a, int b) = 0;
+  virtual void add(int a) = 0;
+  // false only if `assumption` is proven impossible
+  virtual bool satisfiable(int assumption) = 0;
+};
+
+
+struct ezSAT;
+
+
+const char* solver_name(SolverKind kind);
+const char* solver_names();
+bool parse_solver(const std::string &name, SolverKind &kind);
+// Every solver has a context of its own, so solvers may live on different
+// threads. The AIG backend adds its node counts to `aigStats` when
+// destroyed.
+std::unique_ptr<BitSolver> make_bit_solver(SolverKind kind, AigStats &aigStats);
+std::unique_ptr<BitSolver> make_aig_solver(AigStats &stats);
+int ez_keep(ezSAT &ez, int id);
+bool ez_solve(ezSAT &ez, int assumption, int &unknowns);
+
+#endif
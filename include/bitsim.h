@@ -0,0 +1,72 @@
+#ifndef CTRD_BITSIM
+#define CTRD_BITSIM
+
+#include "ctrd_prop.h"
+#include "snapshot.h"
+#include "candidates.h"
+
+#include <memory>
+#include <random>
+
+// Every bit holds SIM_WORDS * 64 patterns. Four words fill one 256-bit
+// vector register, so the word loops vectorize on AVX2 targets.
+#define SIM_WORDS 4
+#define SIM_PATTERNS (SIM_WORDS * 64)
+#define SIM_ROUNDS 16
+
+
+struct SimStats {
+  int candidates = 0;
+  int disproved = 0;
+  long patterns = 0;
+
+  void log_summary() const;
+};
+
+
+// Bit-parallel two-valued simulator for a set of cells of one snapshot
+// module. Pinned bits keep the values they were given; everything not
+// driven by a simulated cell keeps its random value.
+struct BitSim {
+  const SnapModule &sm;
+  std::vector<int> cells;
+  std::vector<uint64_t> val;
+  std::vector<bool> pinned;
+
+  BitSim(const SnapModule &sm, const std::vector<int> &cells);
+  uint64_t* word(int bit) { return &val[bit * SIM_WORDS]; }
+  void randomize(std::mt19937_64 &rng);
+  void pin(const std::vector<int> &bits, const std::vector<uint32_t> &patterns);
+  void run();
+  bool takes(int bit, bool value);
+};
+
+
+// Solver counterexamples waiting to be replayed on the open candidates
+// of their group. Patterns are only simulated when the next candidate of
+// the group is about to be queried.
+struct PatternPool {
+  const NetSnapshot &snap;
+  std::vector<CandidateGroup> groups;
+  std::vector<std::unique_ptr<BitSim>> sims;
+  std::vector<std::vector<uint32_t>> pending;
+  std::vector<std::vector<size_t>> open;
+  std::map<int, int> groupOf;
+  std::mt19937_64 rng;
+  int recycled = 0;
+  int replays = 0;
+  int disproved = 0;
+
+  explicit PatternPool(const NetSnapshot &snap);
+  int group_of(int candidate) const;
+  void add(int group, uint32_t pattern);
+  void replay(int group);
+  void close(int candidate);
+};
+
+
+std::vector<int> fanin_cells(const SnapModule &sm, const std::vector<int> &targets,
+                             const std::vector<int> &stopBits);
+SimStats disprove_by_simulation(const NetSnapshot &snap);
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef CTRD_CANDIDATES
+#define CTRD_CANDIDATES
+
+#include "ctrd_prop.h"
+#include "snapshot.h"
+
+// Open candidates of one instance path that compare the same
+// constrained signal, located in the netlist snapshot. Groups are filled
+// on the main thread, so workers never read the RTLIL cells.
+struct CandidateGroup {
+  int module;
+  std::string path;
+  std::vector<int> root;
+  const ValueSet_t* values;
+  std::vector<int> candidates;  // indexes into g_check_vec
+  std::vector<int> cells;       // snapshot cell of each candidate
+  std::vector<bool> isNe;
+};
+
+
+std::vector<CandidateGroup> group_candidates(const NetSnapshot &snap);
+std::vector<int> root_bits(const SnapModule &sm, RTLIL::SigSpec sig);
+
+#endif
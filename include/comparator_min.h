@@ -0,0 +1,24 @@
+#ifndef CTRD_COMPARATOR_MIN
+#define CTRD_COMPARATOR_MIN
+
+#include "ctrd_prop.h"
+#include "sop.h"
+#include "facts.h"
+
+struct CompMinStats {
+  int comparators = 0;
+  int rewritten = 0;
+  int literalsBefore = 0;
+  int literalsAfter = 0;
+
+  void log_summary() const;
+};
+
+
+std::vector<uint32_t> impossible_values(FactOracle &oracle, RTLIL::SigSpec sig,
+                                        const std::string &path);
+RTLIL::SigSpec build_cover(ModIndex &idx, RTLIL::SigSpec in,
+                           const std::vector<Cube> &cover, bool invert);
+CompMinStats minimize_comparators(FactOracle &oracle, int maxWidth);
+
+#endif
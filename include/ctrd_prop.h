@@ -15,7 +15,12 @@
 #include <vector>
 #include <queue>
 #include <assert.h>
+#include <chrono>
+#ifdef CTRD_HAVE_Z3
 #include <z3++.h>
+#endif
+
+USING_YOSYS_NAMESPACE
 
 struct WorkItem {
   std::string sigName;
@@ -25,24 +30,149 @@ struct WorkItem {
 };
 
 
+#define VERDICT_UNKNOWN -1
+#define VERDICT_VARIES -2
+#define VERDICT_CLUSTER_SAT -3
+
+// verdict is the output value when it is already known without the
+// solver, VERDICT_VARIES if the output was seen to take both values,
+// VERDICT_CLUSTER_SAT if a cluster solver could not prove it, or
+// VERDICT_UNKNOWN. The last two are still open for the final check.
+inline bool verdict_open(int verdict) { return verdict == VERDICT_UNKNOWN || verdict == VERDICT_CLUSTER_SAT; }
+
 struct CheckSet {
   std::string path;
   RTLIL::Cell* cell;
+  RTLIL::SigSpec outSig;
   RTLIL::SigSpec ctrdSig;
   int forbidValue;
+  int verdict;
+};
+
+
+// Compact cell classification used to dispatch propagation handlers,
+// resolved once per cell when the module index is built.
+enum CellKind : uint8_t {
+  CK_OTHER,
+  CK_EQ,
+  CK_NE,
+  CK_LT,      // $lt, $le, $gt and $ge
+  CK_AND,
+  CK_SUBMOD,
+  CK_COUNT
+};
+
+
+// one (cell, port) pair reading or driving a signal bit; id is the
+// cell's dense index in its ModIndex
+struct PortRef {
+  RTLIL::Cell* cell;
+  RTLIL::IdString port;
+  int offset;
+  int id;
+};
+
+
+// Per-module lookup tables, built once and then shared by every query
+// on the module. Wire names map to wires, and every signal bit maps to
+// the cell ports connected to it. Bits read from outside any cell port
+// (module outputs and both sides of module connections) are kept in
+// liveBits. Cells are numbered densely as they are added, so that the
+// kind of a cell reached through a PortRef is a vector index.
+struct ModIndex {
+  RTLIL::Module* module;
+  dict<RTLIL::IdString, RTLIL::Wire*> wires;
+  dict<RTLIL::SigBit, std::vector<PortRef>> bitPorts;
+  pool<RTLIL::SigBit> liveBits;
+  dict<RTLIL::Cell*, int> cellIds;
+  std::vector<RTLIL::Cell*> cellList;  // nullptr once removed
+  std::vector<CellKind> kinds;
+
+  void build(RTLIL::Module* mod);
+  void add_cell(RTLIL::Cell* cell);
+  void remove_cell(RTLIL::Cell* cell);
+  void add_live(RTLIL::SigSpec sig);
+  RTLIL::Wire* wire(const std::string &name) const;
+  const std::vector<PortRef>& ports(RTLIL::SigBit bit) const;
+  std::set<RTLIL::Cell*> cells(RTLIL::SigSpec sig) const;
+  std::set<RTLIL::Cell*> drivers(RTLIL::SigSpec sig) const;
+  std::vector<int> cell_ids(RTLIL::SigSpec sig) const;
+  bool is_read(RTLIL::SigBit bit) const;
+  RTLIL::Cell* cell(int id) const { return cellList[id]; }
+  CellKind kind(int id) const { return kinds[id]; }
 };
 
 
-struct DestGroup {
-  std::set<RTLIL::SigSpec> wires;
-  std::set<std::pair<RTLIL:Cell*, RTLIL::SigSpec>> cellPorts;
+// Backend of the final check and the bit-level encoders.
+enum SolverKind {
+  SOLVER_Z3,
+  SOLVER_SAT,  // Yosys ezSAT on MiniSat
+  SOLVER_AIG   // strashed AIG, then ezSAT
 };
 
-std::queue<WorkItem> g_work_list;
-std::vector<RTLIL::Cell*> g_cell_stack;
-std::set<CheckSet> g_check_set;
-std::map<std::string, expr> g_expr_map;
-typedef std::map<RTLIL::SigSpec, DestGroup> DriveMap_t;
+#ifdef CTRD_HAVE_Z3
+#define SOLVER_DEFAULT SOLVER_Z3
+#else
+#define SOLVER_DEFAULT SOLVER_SAT
+#endif
+
+
+// Queries whose candidate has a smaller fanin (in cells) are not worth
+// the thread and context startup of a race.
+#define PORTFOLIO_MIN_CONE 256
+
+
+// Command line options of opt_ctrd.
+struct CtrdOptions {
+  bool summaries = false;
+  bool parallel = false;
+  bool clusters = false;
+  bool simulate = true;
+  int threads = 0;  // 0 uses every hardware thread
+  SolverKind solver = SOLVER_DEFAULT;
+  std::string cacheFile;  // empty disables the query cache
+  uint64_t cacheEntries = 1 << 20;
+  std::string dumpDir;  // empty disables query dumping
+  unsigned timeout = 0;  // per query, in ms; 0 is no limit
+  unsigned rlimit = 0;   // per query Z3 resource limit; 0 is no limit
+  double budget = 0;     // for the whole pass, in seconds; 0 is no limit
+  bool portfolio = false;
+  int portfolioMinCone = PORTFOLIO_MIN_CONE;  // smallest raced fanin, in cells
+  int procs = 0;  // forked workers of the final check; 0 or 1 is none
+  bool pipeline = false;
+  bool session = false;  // keep the solver between runs
+};
+
+
+// Wall-clock budget of one run. Once it is spent the pass stops asking
+// the solver and commits what it has proven.
+struct PassBudget {
+  std::chrono::steady_clock::time_point start;
+  double seconds = 0;
+
+  void begin(double limit);
+  bool exhausted() const;
+  unsigned remaining_ms() const;  // 0 if there is no budget
+};
+
+
+// The values a narrow signal can still take, one flag per value.
+typedef std::vector<bool> ValueSet_t;
+#define MAX_VALUE_SET_WIDTH 16
+
+
+extern CtrdOptions g_options;
+extern PassBudget g_budget;
+extern std::queue<WorkItem> g_work_list;
+extern std::vector<RTLIL::Cell*> g_cell_stack;
+extern std::vector<CheckSet> g_check_vec;
+#ifdef CTRD_HAVE_Z3
+extern std::map<std::string, z3::expr> g_expr_map;
+#endif
+extern dict<RTLIL::Module*, ModIndex> g_mod_index;
+extern dict<RTLIL::Module*, std::set<std::string>> g_instance_paths;
+extern dict<RTLIL::Module*, std::set<std::string>> g_visited_paths;
+extern std::map<std::string, ValueSet_t> g_value_sets;
 
 
 #endif
@@ -0,0 +1,41 @@
+#ifndef CTRD_DECODER
+#define CTRD_DECODER
+
+#include "ctrd_prop.h"
+
+enum DecoderKind {
+  DEC_NONE,
+  DEC_ONE_HOT,       // every input value raises exactly one output
+  DEC_COMPARE_FAN,   // distinct constants, some values raise nothing
+  DEC_CASE_TABLE     // comparators select constants through a $pmux
+};
+
+
+// A module whose logic only compares one input port against distinct
+// constants, optionally choosing constant outputs with $pmux cells.
+struct DecoderInfo {
+  DecoderKind kind = DEC_NONE;
+  RTLIL::IdString input;
+  int width = 0;
+  std::vector<RTLIL::Cell*> compares;
+  std::vector<uint32_t> constants;
+  std::vector<RTLIL::Cell*> tables;
+};
+
+
+// Closed-form result for one value set: per comparator the constant
+// output (0/1) or -1, and per table the constant output or an empty
+// Const when several entries are still reachable.
+struct DecoderResult {
+  std::vector<int> compares;
+  std::vector<RTLIL::Const> tables;
+};
+
+
+const DecoderInfo& get_decoder_info(RTLIL::Module* module);
+const DecoderResult& get_decoder_result(RTLIL::Module* module, const ValueSet_t &values);
+int decoder_verdict(RTLIL::Cell* cell, const ValueSet_t &values);
+int tie_decoder_tables();
+void clear_decoder_cache();
+
+#endif
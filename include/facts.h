@@ -0,0 +1,114 @@
+#ifndef CTRD_FACTS
+#define CTRD_FACTS
+
+#include "ctrd_prop.h"
+#include "bit_solver.h"
+
+#include <memory>
+
+enum FactKind : uint8_t {
+  FACT_EQ,        // a == b
+  FACT_AND,       // (a & value) == b
+  FACT_NE_CONST,  // a != value
+  FACT_IMPLIES,   // a == value implies b == value2
+  FACT_COMPARE    // b == cell(a, value), the relation of a candidate
+};
+
+
+// `module` as instantiated at `path`. A wire name on a path only means
+// something together with the module found there.
+struct Instance {
+  std::string path;
+  RTLIL::Module* module;
+};
+
+
+// One fact found by propagation. Signals are named by the instance path
+// they were seen on, so the same wire on two paths is two variables.
+// `about` lists the instances whose content the fact depends on.
+struct Fact {
+  FactKind kind;
+  RTLIL::SigSpec a;
+  std::string pathA;
+  RTLIL::SigSpec b;
+  std::string pathB;
+  uint32_t value;
+  uint32_t value2;
+  RTLIL::Cell* cell;
+  std::vector<Instance> about;
+};
+
+
+// `sig` on instance `path` holding `value`.
+struct Pin {
+  RTLIL::SigSpec sig;
+  std::string path;
+  uint32_t value;
+};
+
+
+// Answers questions about the facts in g_facts, on whichever backend.
+// Facts added after the oracle was made are picked up by the next query.
+struct FactOracle {
+  int unknowns = 0;  // queries that hit a limit
+
+  virtual ~FactOracle() { }
+  // encode the facts added since the last call
+  virtual void sync() = 0;
+  // false only if the facts prove that the pins cannot all hold
+  virtual bool possible(const std::vector<Pin> &pins) = 0;
+  // Every value of `sig` the facts allow. False if there are more than
+  // `limit` or a query hit a limit. Every query is added to `checks`.
+  virtual bool enumerate(RTLIL::SigSpec sig, const std::string &path, size_t limit,
+                         std::vector<uint32_t> &values, int &checks);
+  // called with the candidate the next queries decide and its shard
+  // (-1 if unsharded), and with -1 once it is decided
+  virtual void focus(int, int) { }
+  virtual void log_summary() const { }
+};
+
+
+// Facts encoded bit by bit into a BitSolver of its own.
+struct BitFactOracle : public FactOracle {
+  std::unique_ptr<BitSolver> s;
+  std::map<std::string, std::vector<int>> wires;
+  size_t encoded = 0;
+
+  BitFactOracle(SolverKind kind, AigStats &aigStats);
+  void sync() override;
+  bool possible(const std::vector<Pin> &pins) override;
+  std::vector<int> bits(RTLIL::SigSpec sig, const std::string &path);
+  int equals(const std::vector<int> &bits, uint32_t value);
+  void encode(const Fact &fact);
+};
+
+
+extern std::vector<Fact> g_facts;
+
+void add_fact(const Fact &fact);
+
+#ifdef CTRD_HAVE_Z3
+// Facts asserted into a Z3 solver, through the session if one is
+// running. sync_facts() asserts the facts added since its last call.
+struct Z3FactOracle : public FactOracle {
+  z3::solver &s;
+  z3::context &c;
+
+  Z3FactOracle(z3::solver &s, z3::context &c) : s(s), c(c) { }
+  void sync() override;
+  bool possible(const std::vector<Pin> &pins) override;
+  bool enumerate(RTLIL::SigSpec sig, const std::string &path, size_t limit,
+                 std::vector<uint32_t> &values, int &checks) override;
+  // the check of possible(), with the pins asserted in a scope
+  virtual z3::check_result check();
+};
+
+
+z3::expr fact_expr(z3::context &c, const Fact &fact);
+z3::expr pin_expr(z3::context &c, const Pin &pin);
+void sync_facts(z3::solver &s, z3::context &c);
+#endif
+
+void clear_facts();
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef CTRD_INSTANCE_PROP
+#define CTRD_INSTANCE_PROP
+
+#include "ctrd_prop.h"
+#include "snapshot.h"
+
+// One unit of propagation work: the input `port` of the instance of
+// `module` at `path` can only take the values in `values`.
+struct PropTask {
+  std::string path;
+  int module;
+  int port;
+  ValueSet_t values;
+};
+
+
+// A comparator whose output is the same for every value a task allows.
+struct SimVerdict {
+  std::string path;
+  std::string cell;
+  int value;
+
+  bool operator<(const SimVerdict &other) const {
+    return path != other.path ? path < other.path : cell < other.cell;
+  }
+};
+
+
+// Comparator outputs by (instance path, cell name).
+extern std::map<std::pair<std::string, std::string>, int> g_sim_verdicts;
+
+void propagate_instances(const NetSnapshot &snap, RTLIL::Module* top, RTLIL::SigSpec sig,
+                         const ValueSet_t &values, int threads);
+int sim_verdict(const std::string &path, RTLIL::Cell* cell);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef CTRD_MUX_CHAIN
+#define CTRD_MUX_CHAIN
+
+#include "ctrd_prop.h"
+#include "facts.h"
+
+// One priority chain of $mux cells, highest priority first. Mux i
+// selects cases[i] when selects[i] is set and falls through to the next
+// mux otherwise; the last one falls through to `fallback`.
+struct MuxChain {
+  std::vector<RTLIL::Cell*> muxes;
+  std::vector<RTLIL::SigSpec> selects;
+  std::vector<RTLIL::SigSpec> cases;
+  RTLIL::SigSpec fallback;
+};
+
+
+struct MuxChainStats {
+  int chains = 0;
+  int muxes = 0;
+  int pmuxes = 0;
+  int droppedCases = 0;
+  int depthBefore = 0;
+  int depthAfter = 0;
+
+  void add(const MuxChainStats &other);
+  void log_summary() const;
+};
+
+
+std::vector<MuxChain> find_mux_chains(const ModIndex &idx);
+MuxChainStats collapse_mux_chains(FactOracle &oracle, ModIndex &idx,
+                                  const std::set<std::string> &paths);
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef CTRD_NETLIST_EDIT
+#define CTRD_NETLIST_EDIT
+
+#include "ctrd_prop.h"
+
+#include <functional>
+
+// Builds replacement logic in the module behind the index and returns
+// the signal that now drives the rewritten output.
+typedef std::function<RTLIL::SigSpec(ModIndex&)> Builder_t;
+
+// A proven rewrite: the output `sig` of `cell` is always `value`, so
+// the cell is removed and the signal is driven by the constant. If
+// `build` is set the signal is driven by the logic it creates instead.
+// If `port` is set only that output port is cut off and the cell stays.
+struct Edit {
+  RTLIL::Module* module;
+  RTLIL::Cell* cell;
+  RTLIL::SigSpec sig;
+  RTLIL::Const value;
+  Builder_t build;
+  RTLIL::IdString port;
+};
+
+
+// What a commit removed from the design.
+struct EditStats {
+  int tied = 0;
+  int replaced = 0;
+  int folded = 0;
+  int swept = 0;
+  int carried = 0;
+  dict<RTLIL::IdString, int> removedTypes;
+
+  void log_summary() const;
+};
+
+
+// Rewrites are recorded while the solver runs and applied together
+// afterwards, so module indexes stay valid during propagation.
+struct EditLog {
+  std::vector<Edit> edits;
+
+  void tie_const(RTLIL::Cell* cell, RTLIL::SigSpec sig, RTLIL::Const value);
+  void replace(RTLIL::Cell* cell, RTLIL::SigSpec sig, Builder_t build);
+  void tie_port(RTLIL::Cell* cell, RTLIL::IdString port, RTLIL::SigSpec sig, RTLIL::Const value);
+  bool has_edit(RTLIL::Cell* cell) const;
+  EditStats commit();
+  void clear() { edits.clear(); }
+};
+
+
+extern EditLog g_edit_log;
+
+int fold_constants(ModIndex &idx, dict<RTLIL::SigBit, RTLIL::State> &constBits,
+                   std::set<RTLIL::Cell*> work, std::set<RTLIL::Cell*> &seeds, EditStats &stats);
+int sweep_dead_cone(ModIndex &idx, const std::set<RTLIL::Cell*> &seeds, EditStats &stats);
+
+#endif
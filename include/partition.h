@@ -0,0 +1,39 @@
+#ifndef CTRD_PARTITION
+#define CTRD_PARTITION
+
+#include "ctrd_prop.h"
+#include "snapshot.h"
+#include "candidates.h"
+#include "aig.h"
+#include "bdd.h"
+#include "query_cache.h"
+
+// Cells of one connected component of a constrained fanout cone, in
+// topological order, and the candidates of the group that lie in it.
+struct Cluster {
+  const CandidateGroup* group;
+  std::vector<int> cells;
+  std::vector<int> members;  // positions in group->candidates
+};
+
+
+struct ClusterStats {
+  int cones = 0;
+  int clusters = 0;
+  int candidates = 0;
+  int proven = 0;
+  int satisfiable = 0;  // satisfiable in their cluster, so checked again
+  std::vector<int> sizes;
+  SolverKind solver = SOLVER_Z3;
+  AigStats aig;
+  BddStats bdd;
+  CacheStats cache;
+  std::string cacheFile;
+
+  void log_summary(int threads) const;
+};
+
+
+ClusterStats solve_clusters(const NetSnapshot &snap, int threads, SolverKind kind);
+
+#endif
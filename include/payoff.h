@@ -0,0 +1,25 @@
+#ifndef CTRD_PAYOFF
+#define CTRD_PAYOFF
+
+#include "ctrd_prop.h"
+#include "snapshot.h"
+
+// one level of logic saved counts as much as this many cells
+#define PAYOFF_DEPTH_WEIGHT 2
+
+
+// Logic expected to go away if a candidate is proven constant: the
+// cells that only feed it, plus the smaller data input of every mux it
+// selects, and the depth of the logic it drives.
+struct Payoff {
+  int cells = 0;
+  int depth = 0;
+
+  int score() const { return cells + PAYOFF_DEPTH_WEIGHT * depth; }
+};
+
+
+std::vector<Payoff> estimate_payoffs(const NetSnapshot &snap);
+std::vector<int> payoff_order(const std::vector<Payoff> &payoffs);
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef CTRD_PIPELINE
+#define CTRD_PIPELINE
+
+#include "ctrd_prop.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+// Candidates travel in batches; the queue holds at most this many.
+#define PIPELINE_BATCH 64
+#define PIPELINE_QUEUE_SIZE 64
+
+
+// Blocking FIFO of bounded size. push() waits while the queue is full,
+// which holds the producer back; pop() fails once the queue is closed
+// and empty.
+template<typename T>
+struct BoundedQueue {
+  std::mutex lock;
+  std::condition_variable notFull;
+  std::condition_variable notEmpty;
+  std::deque<T> items;
+  size_t capacity;
+  bool closed = false;
+
+  explicit BoundedQueue(size_t capacity) : capacity(capacity) { }
+
+  // true if the caller had to wait
+  bool push(T item) {
+    std::unique_lock<std::mutex> guard(lock);
+    bool waited = items.size() >= capacity;
+    notFull.wait(guard, [this]() { return items.size() < capacity; });
+    items.push_back(std::move(item));
+    notEmpty.notify_one();
+    return waited;
+  }
+
+  bool pop(T &item) {
+    std::unique_lock<std::mutex> guard(lock);
+    notEmpty.wait(guard, [this]() { return closed || !items.empty(); });
+    if(items.empty()) return false;
+    item = std::move(items.front());
+    items.pop_front();
+    notFull.notify_one();
+    return true;
+  }
+
+  void close() {
+    std::lock_guard<std::mutex> guard(lock);
+    closed = true;
+    notEmpty.notify_all();
+  }
+};
+
+
+// One candidate as SMT-LIB text: its relation plus an assumption on its
+// output per value it could be tied to, tried in order.
+struct PipeQuery {
+  int candidate;
+  std::vector<int> values;
+  std::vector<std::string> queries;
+};
+
+
+// Queries and how many assertion deltas a worker needs before them.
+struct PipeBatch {
+  size_t deltas = 0;
+  std::vector<PipeQuery> queries;
+};
+
+
+struct PipelineStats {
+  int candidates = 0;
+  int batches = 0;
+  int proven = 0;
+  int blocked = 0;
+  double firstMs = -1;
+  double totalMs = 0;
+
+  void log_summary(int threads) const;
+};
+
+
+// Solves candidates while propagation is still finding them. The
+// workers cannot share the main context, so the main thread sends the
+// assertions made since the last batch as SMT-LIB text, and each worker
+// replays them into a context of its own before solving the batch.
+// Assertions made after a candidate was found are not needed: fewer
+// facts can only turn an unsat answer into sat, never the reverse.
+struct SolvePipeline {
+  z3::solver &s;
+  z3::context &c;
+  BoundedQueue<PipeBatch> queue;
+  std::mutex deltaLock;
+  std::vector<std::string> deltas;
+  unsigned sent = 0;
+  PipeBatch pending;
+  std::vector<std::thread> workers;
+  std::mutex resultLock;
+  std::vector<std::pair<int, int>> results;
+  std::chrono::steady_clock::time_point start;
+  std::atomic<bool> answered;
+  PipelineStats stats;
+
+  SolvePipeline(z3::solver &s, z3::context &c);
+  void begin(int threads);
+  void submit(int candidate);
+  void flush();
+  void finish();
+  void work();
+};
+
+
+extern SolvePipeline* g_pipeline;
+
+#endif
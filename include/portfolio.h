@@ -0,0 +1,21 @@
+#ifndef CTRD_PORTFOLIO
+#define CTRD_PORTFOLIO
+
+#include "ctrd_prop.h"
+
+struct PortfolioStats {
+  int races = 0;
+  int skipped = 0;
+  int undecided = 0;
+  std::map<std::string, int> wins;
+
+  void log_summary() const;
+};
+
+
+extern const std::vector<std::string> g_solver_configs;
+
+z3::solver make_config_solver(z3::context &c, const std::string &config);
+z3::check_result race_query(z3::solver &s, PortfolioStats &stats);
+
+#endif
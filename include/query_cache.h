@@ -0,0 +1,63 @@
+#ifndef CTRD_QUERY_CACHE
+#define CTRD_QUERY_CACHE
+
+#include "ctrd_prop.h"
+
+#define QCACHE_PROBES 8
+
+// 128-bit structural hash of a query; never all zero.
+struct QueryKey {
+  uint64_t hi;
+  uint64_t lo;
+};
+
+
+// Incremental 128-bit hash over 64-bit words.
+struct QueryHasher {
+  uint64_t hi = 0x243f6a8885a308d3ull;
+  uint64_t lo = 0x13198a2e03707344ull;
+
+  void add(uint64_t word);
+  void add(const std::string &str);
+  QueryKey key() const;
+};
+
+
+struct CacheStats {
+  int lookups = 0;
+  int hits = 0;
+  int inserts = 0;
+  int evictions = 0;
+
+  void log_summary(const std::string &path) const;
+};
+
+
+// Query results shared across runs in a memory-mapped file. The file
+// is a fixed-size open-addressed table; a full probe window evicts its
+// least recently used entry. Only definitive results belong in it: a
+// stored VERDICT_UNKNOWN is treated as a miss. Callers take the file lock around every
+// batch of lookups or inserts, so concurrent processes see whole
+// entries only.
+struct QueryCache {
+  struct Header;
+  struct Entry;
+
+  std::string path;
+  int fd = -1;
+  size_t bytes = 0;
+  Header* header = nullptr;
+  Entry* entries = nullptr;
+  CacheStats stats;
+
+  ~QueryCache() { close(); }
+  bool open(const std::string &file, uint64_t capacity);
+  void close();
+  bool is_open() const { return header != nullptr; }
+  void lock(bool exclusive);
+  void unlock();
+  bool lookup(const QueryKey &key, int &result);
+  void insert(const QueryKey &key, int result);
+};
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef CTRD_QUERY_DUMP
+#define CTRD_QUERY_DUMP
+
+#include "ctrd_prop.h"
+#include "snapshot.h"
+
+// Writes every query of simplify() as a standalone SMT-LIB file with
+// its candidate in leading comments, for replay with opt_ctrd_replay.
+struct QueryDumper {
+  std::string dir;
+  std::string prefix;  // keeps the files of concurrent writers apart
+  int count = 0;
+
+  bool open(const std::string &path);
+  bool is_open() const { return !dir.empty(); }
+  void dump(z3::solver &s, const CheckSet &set, int coneSize, z3::check_result result);
+};
+
+
+// metadata read back from the comments of a dumped query
+struct QueryInfo {
+  std::string file;
+  std::string cell;
+  std::string type;
+  std::string path;
+  int cone = 0;
+  std::string expected;
+};
+
+
+int cone_size(const NetSnapshot &snap, RTLIL::Cell* cell);
+std::string result_name(z3::check_result result);
+std::vector<std::string> list_queries(const std::string &dir);
+QueryInfo read_query_info(const std::string &file);
+
+#endif
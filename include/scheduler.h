@@ -0,0 +1,63 @@
+#ifndef CTRD_SCHEDULER
+#define CTRD_SCHEDULER
+
+#include "ctrd_prop.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+// A task gets the number of the worker running it, so that the tasks
+// it spawns go to that worker's own deque.
+typedef std::function<void(int)> Task_t;
+
+
+// Counters of one scheduler run, summed over the workers.
+struct SchedStats {
+  long tasks = 0;
+  long steals = 0;
+  long failedSteals = 0;
+  long idle = 0;
+
+  void add(const SchedStats &other);
+  void log_summary(int threads) const;
+};
+
+
+struct WorkerQueue {
+  std::mutex lock;
+  std::deque<Task_t> tasks;
+  SchedStats stats;
+};
+
+
+// Work-stealing pool: every worker pops the newest task of its own
+// deque and, when that is empty, steals the oldest task of another.
+// A worker that finds nothing to pop or steal sleeps until a task is
+// spawned or the last one finishes. run() returns once every task,
+// including spawned ones, has finished.
+struct TaskScheduler {
+  explicit TaskScheduler(int threads);
+
+  void spawn(int worker, Task_t task);
+  void run();
+  int threads() const { return queues.size(); }
+  SchedStats stats() const;
+
+private:
+  std::vector<std::unique_ptr<WorkerQueue>> queues;
+  std::atomic<long> pending;
+  std::atomic<long> queued;  // spawned but not yet taken
+  std::mutex idleLock;
+  std::condition_variable wake;
+
+  bool pop(int worker, Task_t &task);
+  bool steal(int worker, Task_t &task);
+  void work(int worker);
+  void notify(bool all);
+};
+
+#endif
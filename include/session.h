@@ -0,0 +1,71 @@
+#ifndef CTRD_SESSION
+#define CTRD_SESSION
+
+#include "ctrd_prop.h"
+#include "query_cache.h"
+#include "facts.h"
+
+#include <memory>
+
+
+struct SessionStats {
+  int runs = 0;
+  int reused = 0;
+  int encoded = 0;
+  int retired = 0;
+  int facts = 0;
+  int skipped = 0;
+
+  void log_summary() const;
+};
+
+
+// Facts of one module at one instance path, asserted behind a guard
+// literal.
+struct InstanceEncoding {
+  std::string module;
+  QueryKey hash;
+  std::string guard;
+};
+
+
+// Solver state kept between opt_ctrd runs with -session. Facts found by
+// propagation are asserted at the base level behind the guard of every
+// instance they describe, keyed by path and module. A run asserts a
+// guard in a scope of its own once it has seen that module on that path
+// itself, so a path now holding another module does not pick up the
+// facts of the old one. A module whose content hash changed gets new
+// guards, and the old ones are asserted false so their facts drop out.
+// Everything is released by opt_ctrd_flush or once the design loses
+// all of its modules, as `design -reset` does.
+struct CtrdSession : public RTLIL::Monitor {
+  Design* design = nullptr;
+  std::unique_ptr<z3::context> c;
+  std::unique_ptr<z3::solver> s;
+  std::map<std::string, InstanceEncoding> instances;
+  std::set<std::string> active;
+  size_t visited = 0;
+  std::vector<std::string> retired;
+  std::set<unsigned> known;
+  std::unique_ptr<z3::expr_vector> pending;
+  int runs = 0;
+  bool running = false;
+  SessionStats stats;
+
+  void begin(Design* d);
+  void end();
+  void release();
+  void add(const z3::expr &fact, const std::vector<Instance> &about);
+  void visit();
+  z3::expr guard(const Instance &instance);
+
+  void notify_module_del(RTLIL::Module* module) override;
+};
+
+
+QueryKey module_hash(RTLIL::Module* module);
+void assert_fact(z3::solver &s, const z3::expr &fact, const std::vector<Instance> &about);
+
+extern CtrdSession g_session;
+
+#endif
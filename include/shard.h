@@ -0,0 +1,25 @@
+#ifndef CTRD_SHARD
+#define CTRD_SHARD
+
+#include "ctrd_prop.h"
+
+#include <functional>
+
+// Answers of the candidates of one shard, indexed like g_check_vec.
+typedef std::function<std::vector<int>(int shard)> ShardWork_t;
+
+
+struct ShardStats {
+  int procs = 0;
+  int records = 0;
+  int failed = 0;  // workers that died before sending all their records
+
+  void log_summary() const;
+};
+
+
+std::vector<int> assign_shards(const std::vector<int> &ranked, int procs);
+std::vector<int> run_sharded(int procs, const std::vector<int> &shardOf, ShardWork_t work,
+                             ShardStats &stats);
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef CTRD_SNAPSHOT
+#define CTRD_SNAPSHOT
+
+#include "ctrd_prop.h"
+
+// Bit numbers 0, 1 and 2 stand for the constants 0, 1 and x.
+#define BIT_CONST0 0
+#define BIT_CONST1 1
+#define BIT_CONSTX 2
+
+// Port directions, also used for cell connections.
+#define PORT_IN  1
+#define PORT_OUT 2
+
+// Names every snapshot interns first, so primitive ports are found
+// without string compares.
+enum SnapName : int { NAME_A, NAME_B, NAME_S, NAME_Y, NAME_COUNT };
+
+
+enum SnapOp : uint8_t {
+  OP_UNKNOWN,
+  OP_NOT, OP_AND, OP_OR, OP_XOR, OP_XNOR,
+  OP_REDUCE_AND, OP_REDUCE_OR, OP_REDUCE_XOR, OP_REDUCE_BOOL,
+  OP_LOGIC_NOT, OP_LOGIC_AND, OP_LOGIC_OR,
+  OP_EQ, OP_NE, OP_MUX, OP_PMUX,
+  OP_INSTANCE
+};
+
+
+// The bits of one connection or wire, as a view into SnapModule::bits.
+struct BitRange {
+  const int* first;
+  const int* last;
+
+  size_t size() const { return last - first; }
+  bool empty() const { return first == last; }
+  int operator[](size_t i) const { return first[i]; }
+  const int* begin() const { return first; }
+  const int* end() const { return last; }
+};
+
+
+// One module with every object numbered densely from 0. Bits are
+// numbered after SigMap, so connected wires share their bits. Cells are
+// stored as parallel arrays; the connections of cell i are
+// [cellConn[i], cellConn[i+1]) and the bits of connection j are
+// bits[connBit[j]] .. bits[connBit[j+1] - 1]. Instances list one
+// connection per child port in the child's port order.
+struct SnapModule {
+  std::string name;
+  int numBits = 3;
+
+  std::vector<std::string> wireName;
+  std::vector<int> wireWidth;
+  std::vector<int> wireBit;
+
+  std::vector<int> portWire;
+  std::vector<uint8_t> portDir;
+
+  std::vector<std::string> cellName;
+  std::vector<SnapOp> cellOp;
+  std::vector<int> cellChild;
+  std::vector<int> cellConn;
+
+  std::vector<int> connName;
+  std::vector<uint8_t> connDir;
+  std::vector<int> connBit;
+
+  std::vector<int> bits;
+  std::vector<int> order;
+  std::vector<int> children;
+
+  // names to ids, filled when the snapshot is built
+  dict<std::string, int> wireIds;
+  dict<std::string, int> cellIds;
+  std::vector<int> wirePort;  // port of each wire, or -1
+
+  int num_cells() const { return cellOp.size(); }
+  BitRange wire_bits(int wire) const;
+  BitRange conn_bits(int conn) const;
+  BitRange port_bits(int port) const { return wire_bits(portWire[port]); }
+  int find_conn(int cell, int name) const;
+  int find_wire(const std::string &name) const;
+  int find_cell(const std::string &name) const;
+  BitRange cell_bits(int cell, int name) const;
+};
+
+
+// Frozen copy of the design, built once per pass run on the main thread
+// and only read afterwards, so worker threads may use it without locks.
+// `index` and `sources` map back to RTLIL and are for the main thread.
+struct NetSnapshot {
+  std::vector<SnapModule> modules;
+  std::vector<std::string> names;
+  dict<RTLIL::Module*, int> index;
+  std::vector<RTLIL::Module*> sources;
+
+  void build(Design* design);
+  int module_id(RTLIL::Module* module) const;
+  int port_id(int module, const std::string &name) const;
+  void clear();
+};
+
+
+extern NetSnapshot g_snapshot;
+
+#endif
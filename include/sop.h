@@ -0,0 +1,28 @@
+#ifndef CTRD_SOP
+#define CTRD_SOP
+
+#include <cstdint>
+#include <vector>
+
+// A product term over a narrow input: bits set in `mask` are literals,
+// and `value` gives their required polarity.
+struct Cube {
+  uint32_t value;
+  uint32_t mask;
+
+  bool covers(uint32_t minterm) const { return (minterm & mask) == value; }
+  int literals() const { return __builtin_popcount(mask); }
+  bool operator<(const Cube &o) const {
+    return mask != o.mask ? mask < o.mask : value < o.value;
+  }
+  bool operator==(const Cube &o) const { return mask == o.mask && value == o.value; }
+};
+
+
+// Two-level minimization (Quine-McCluskey with a greedy cover) of the
+// function that is 1 on `on`, free on `dc` and 0 elsewhere.
+std::vector<Cube> minimize_sop(int width, const std::vector<uint32_t> &on,
+                               const std::vector<uint32_t> &dc);
+int cover_literals(const std::vector<Cube> &cover);
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef CTRD_SUMMARY
+#define CTRD_SUMMARY
+
+#include "ctrd_prop.h"
+#include "snapshot.h"
+
+// Ternary value of one bit.
+enum Tern : uint8_t { T0, T1, TX };
+
+#define SUMMARY_MAX_WIDTH 8
+
+
+// The output ports of a module for every value of one narrow input
+// port, with all other inputs unknown: table[v] holds the ternary bits
+// of all outputs, concatenated in port order. `input` is a port index
+// of the snapshot module.
+struct PortTransfer {
+  int input;
+  std::vector<std::vector<Tern>> table;
+};
+
+
+struct ModuleSummary {
+  std::vector<PortTransfer> transfers;
+};
+
+
+// An instance output port found constant on one instance path.
+struct PortFact {
+  std::string path;
+  RTLIL::Cell* cell;
+  RTLIL::IdString port;
+  RTLIL::SigSpec sig;
+  RTLIL::Const value;
+};
+
+
+// Summaries are indexed like g_snapshot.modules.
+extern std::vector<ModuleSummary> g_summaries;
+extern std::vector<PortFact> g_port_facts;
+
+std::vector<Tern> ternary_simulate(const NetSnapshot &snap, const SnapModule &sm, int port,
+                                   uint32_t v, const std::vector<ModuleSummary> &summaries);
+void build_summaries(const NetSnapshot &snap, int threads);
+const PortTransfer* find_transfer(RTLIL::Module* module, RTLIL::IdString port);
+std::vector<Tern> transfer_outputs(const PortTransfer &transfer, const ValueSet_t &values);
+bool consult_summary(RTLIL::Cell* cell, RTLIL::Module* subMod, RTLIL::IdString port,
+                     RTLIL::SigSpec ctrdSig, const ValueSet_t &values);
+int apply_port_facts();
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef CTRD_UTIL
+#define CTRD_UTIL
+
+#include "ctrd_prop.h"
+
+std::string toStr(int i);
+void print_module(RTLIL::Module *module);
+CellKind get_cell_kind(RTLIL::Cell* cell);
+bool complete_signal(RTLIL::SigSpec sig);
+bool equal_width(RTLIL::SigSpec sig1, RTLIL::SigSpec sig2);
+
+ModIndex& get_mod_index(RTLIL::Module* module);
+void invalidate_mod_index(RTLIL::Module* module);
+RTLIL::IdString get_cell_port(const ModIndex &idx, RTLIL::SigSpec sig, RTLIL::Cell *cell);
+void enumerate_instance_paths(RTLIL::Module* top);
+bool all_paths_visited(RTLIL::Module* module);
+RTLIL::Module* get_subModule(Design* design, RTLIL::Cell* cell);
+RTLIL::SigSpec get_sigspec(const ModIndex &idx, 
+                           std::string inputName, int offset, int length);
+RTLIL::SigSpec get_port_sigspec(const ModIndex &idx, RTLIL::IdString port);
+
+void enter_instance(RTLIL::Cell* cell);
+void leave_instance();
+const std::string &get_path();
+std::string get_path(const std::vector<RTLIL::Cell*> &cell_stack);
+std::string get_hier_name(RTLIL::SigSpec inputSig);
+std::string get_hier_name(RTLIL::SigSpec inputSig, const std::string &path);
+bool get_bit(uint32_t value, uint32_t pos);
+void add_neq_ctrd(RTLIL::Module* module, RTLIL::SigSpec inputSig, int forbidValue);
+unsigned query_timeout();
+#ifdef CTRD_HAVE_Z3
+z3::expr wire_expr(z3::context &c, RTLIL::SigSpec sig, const std::string &path);
+z3::expr get_expr(z3::context &c, RTLIL::SigSpec sig, std::string path = "");
+z3::expr as_bool(z3::context &c, const z3::expr &e);
+void limit_query(z3::solver &s);
+#endif
+
+#endif
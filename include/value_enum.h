@@ -0,0 +1,34 @@
+#ifndef CTRD_VALUE_ENUM
+#define CTRD_VALUE_ENUM
+
+#include "ctrd_prop.h"
+
+// Signals up to this width have their reachable values enumerated once
+// instead of one query per comparator, when their comparators would
+// need more queries than the signal has values.
+#define ENUM_MAX_WIDTH 8
+
+
+struct EnumStats {
+  int signals = 0;
+  int values = 0;
+  int answered = 0;
+  int aborted = 0;
+  int checks = 0;  // solver calls spent on enumeration
+
+  void log_summary() const;
+};
+
+
+bool is_ordered_compare(RTLIL::Cell* cell);
+int compare_output(RTLIL::Cell* cell, RTLIL::SigSpec ctrdSig, uint32_t value, uint32_t constant);
+int lookup_verdict(const CheckSet &set, const std::vector<uint32_t> &values);
+bool compare_modelled(RTLIL::Cell* cell, RTLIL::SigSpec ctrdSig);
+#ifdef CTRD_HAVE_Z3
+bool compare_expr(z3::context &c, RTLIL::Cell* cell, RTLIL::SigSpec ctrdSig,
+                  const z3::expr &ctrdExpr, uint32_t constant, z3::expr &result);
+bool enumerate_values(z3::solver &s, const z3::expr &sigExpr, int width, size_t limit,
+                      std::vector<uint32_t> &values, int &checks);
+#endif
+
+#endif
@@ -0,0 +1,150 @@
+#include "ctrd_prop.h"
+#include "util.h"
+#include "kernel/satgen.h"
+#include "aig.h"
+#include "bit_solver.h"
+
+USING_YOSYS_NAMESPACE
+
+
+void AigStats::add(const AigStats &other) {
+  requested += other.requested;
+  folded += other.folded;
+  hashed += other.hashed;
+  nodes += other.nodes;
+  queries += other.queries;
+}
+
+
+void AigStats::log_summary() const {
+  if(requested == 0) return;
+  log("AIG: %ld AND gates requested, %ld folded, %ld merged by strash, %ld nodes built; %d SAT queries.\n",
+      requested, folded, hashed, nodes, queries);
+}
+
+
+Aig::Aig() {
+  fanin0.push_back(AIG_FALSE);
+  fanin1.push_back(AIG_FALSE);
+}
+
+
+AigLit Aig::input() {
+  fanin0.push_back(AIG_INPUT);
+  fanin1.push_back(AIG_INPUT);
+  return (fanin0.size() - 1) * 2;
+}
+
+
+/// AND of two literals after constant propagation, one-level rewrites and
+/// structural hashing
+AigLit Aig::and_lit(AigLit a, AigLit b) {
+  stats.requested++;
+  if(a > b) std::swap(a, b);
+  if(a == AIG_FALSE || a == aig_not(b)) {
+    stats.folded++;
+    return AIG_FALSE;
+  }
+  if(a == AIG_TRUE || a == b) {
+    stats.folded++;
+    return b;
+  }
+  // a & (a & c) = a & c and a & (!a & c) = 0, either way round
+  for(int side = 0; side < 2; side++) {
+    AigLit x = side ? b : a, y = side ? a : b;
+    uint32_t node = aig_node(y);
+    if((y & 1) || node == 0 || is_input(node)) continue;
+    if(fanin0[node] == x || fanin1[node] == x) {
+      stats.folded++;
+      return y;
+    }
+    if(fanin0[node] == aig_not(x) || fanin1[node] == aig_not(x)) {
+      stats.folded++;
+      return AIG_FALSE;
+    }
+  }
+  uint64_t key = (uint64_t)a << 32 | b;
+  auto it = strash.find(key);
+  if(it != strash.end()) {
+    stats.hashed++;
+    return it->second * 2;
+  }
+  uint32_t node = fanin0.size();
+  fanin0.push_back(a);
+  fanin1.push_back(b);
+  strash[key] = node;
+  stats.nodes++;
+  return node * 2;
+}
+
+
+PRIVATE_NAMESPACE_BEGIN
+
+// The encoders build an AIG; each query hands the nodes it has not seen
+// yet to an incremental SAT solver.
+struct AigBitSolver : public BitSolver {
+  Aig aig;
+  ezSatPtr ez;
+  std::vector<int> satLits;  // per node, 0 until encoded
+  std::vector<AigLit> pending;
+  AigStats &sink;
+
+  explicit AigBitSolver(AigStats &sink) : sink(sink) { }
+  ~AigBitSolver() { sink.add(aig.stats); }
+
+  int lit_const(bool value) override { return value ? AIG_TRUE : AIG_FALSE; }
+  int lit_new() override { return aig.input(); }
+  int lit_not(int a) override { return aig_not(a); }
+  int lit_and(int a, int b) override { return aig.and_lit(a, b); }
+  int lit_or(int a, int b) override { return aig.or_lit(a, b); }
+  int lit_xor(int a, int b) override { return aig.xor_lit(a, b); }
+  int lit_iff(int a, int b) override { return aig_not(aig.xor_lit(a, b)); }
+  int lit_ite(int sel, int a, int b) override { return aig.ite_lit(sel, a, b); }
+  void add(int a) override { pending.push_back(a); }
+  int encode(AigLit lit);
+  bool satisfiable(int assumption) override;
+};
+
+
+int AigBitSolver::encode(AigLit lit) {
+  satLits.resize(aig.num_nodes(), 0);
+  satLits[0] = ezSAT::CONST_FALSE;
+  std::vector<uint32_t> work{aig_node(lit)};
+  while(!work.empty()) {
+    uint32_t node = work.back();
+    if(satLits[node] != 0) {
+      work.pop_back();
+      continue;
+    }
+    if(aig.is_input(node)) {
+      satLits[node] = ez_keep(*ez, ez->literal());
+      work.pop_back();
+      continue;
+    }
+    uint32_t n0 = aig_node(aig.fanin0[node]), n1 = aig_node(aig.fanin1[node]);
+    if(satLits[n0] == 0) work.push_back(n0);
+    if(satLits[n1] == 0) work.push_back(n1);
+    if(satLits[n0] == 0 || satLits[n1] == 0) continue;
+    auto fanin = [&](AigLit f) { return (f & 1) ? ez->NOT(satLits[aig_node(f)]) : satLits[aig_node(f)]; };
+    satLits[node] = ez_keep(*ez, ez->AND(fanin(aig.fanin0[node]), fanin(aig.fanin1[node])));
+    work.pop_back();
+  }
+  int result = satLits[aig_node(lit)];
+  return (lit & 1) ? ez->NOT(result) : result;
+}
+
+
+bool AigBitSolver::satisfiable(int assumption) {
+  aig.stats.queries++;
+  for(auto lit: pending) ez->assume(encode(lit));
+  pending.clear();
+  if(assumption == AIG_FALSE) return false;
+  return ez_solve(*ez, ez_keep(*ez, encode(assumption)), unknowns);
+}
+
+PRIVATE_NAMESPACE_END
+
+
+std::unique_ptr<BitSolver> make_aig_solver(AigStats &stats) {
+  return std::unique_ptr<BitSolver>(new AigBitSolver(stats));
+}
@@ -0,0 +1,149 @@
+#include "ctrd_prop.h"
+#include "util.h"
+#include "bdd.h"
+
+USING_YOSYS_NAMESPACE
+
+// level of the terminals and marker of free slots
+#define BDD_TERMINAL 0xffffffffu
+#define BDD_FREE 0xfffffffeu
+
+
+void BddStats::add(const BddStats &other) {
+  candidates += other.candidates;
+  decided += other.decided;
+  overflows += other.overflows;
+  collections += other.collections;
+  freed += other.freed;
+  peakNodes = std::max(peakNodes, other.peakNodes);
+}
+
+
+void BddStats::log_summary() const {
+  if(candidates == 0) return;
+  log("BDDs decided %d of %d small-support candidates (%d over the node limit); "
+      "peak %ld nodes, %d collections freed %ld.\n",
+      decided, candidates, overflows, peakNodes, collections, freed);
+}
+
+
+Bdd::Bdd(BddStats &stats) : cache(1 << BDD_CACHE_BITS, CacheEntry{BDD_TERMINAL, 0, 0, 0}), stats(stats) {
+  for(uint32_t t = 0; t < 2; t++) {
+    var.push_back(BDD_TERMINAL);
+    lo.push_back(t);
+    hi.push_back(t);
+  }
+}
+
+
+uint32_t Bdd::new_var() {
+  return make(numVars++, BDD_FALSE, BDD_TRUE);
+}
+
+
+uint32_t Bdd::make(uint32_t v, uint32_t l, uint32_t h) {
+  if(l == h) return l;
+  uint64_t key = (uint64_t)l << 32 | h;
+  std::vector<uint32_t> &bucket = unique[key];
+  for(auto node: bucket)
+    if(var[node] == v) return node;
+  if(live >= BDD_MAX_NODES) {
+    overflow = true;
+    return BDD_FALSE;
+  }
+  uint32_t node;
+  if(!freeList.empty()) {
+    node = freeList.back();
+    freeList.pop_back();
+    var[node] = v;
+    lo[node] = l;
+    hi[node] = h;
+  }
+  else {
+    node = var.size();
+    var.push_back(v);
+    lo.push_back(l);
+    hi.push_back(h);
+  }
+  bucket.push_back(node);
+  live++;
+  stats.peakNodes = std::max(stats.peakNodes, live);
+  return node;
+}
+
+
+uint32_t Bdd::apply(Op op, uint32_t a, uint32_t b) {
+  if(overflow) return BDD_FALSE;
+  if(a > b) std::swap(a, b);
+  switch(op) {
+  case OP_AND:
+    if(a == BDD_FALSE) return BDD_FALSE;
+    if(a == BDD_TRUE || a == b) return b;
+    break;
+  case OP_OR:
+    if(a == BDD_TRUE) return BDD_TRUE;
+    if(a == BDD_FALSE || a == b) return b;
+    break;
+  case OP_XOR:
+    if(a == b) return BDD_FALSE;
+    if(a == BDD_FALSE) return b;
+    break;
+  }
+  uint32_t slot = ((uint64_t)a * 0x9e3779b1u + (uint64_t)b * 0x85ebca6bu + op) & ((1u << BDD_CACHE_BITS) - 1);
+  CacheEntry &entry = cache[slot];
+  if(entry.op == op && entry.a == a && entry.b == b) return entry.result;
+  // terminals sit below every variable
+  uint32_t v = std::min(var[a], var[b]);
+  uint32_t aLo = var[a] == v ? lo[a] : a, aHi = var[a] == v ? hi[a] : a;
+  uint32_t bLo = var[b] == v ? lo[b] : b, bHi = var[b] == v ? hi[b] : b;
+  uint32_t l = apply(op, aLo, bLo);
+  uint32_t h = apply(op, aHi, bHi);
+  uint32_t result = make(v, l, h);
+  if(overflow) return BDD_FALSE;
+  cache[slot] = CacheEntry{op, a, b, result};
+  return result;
+}
+
+
+/// free every node not reachable from `roots`
+void Bdd::collect(const std::vector<uint32_t> &roots) {
+  std::vector<bool> marked(var.size(), false);
+  marked[BDD_FALSE] = marked[BDD_TRUE] = true;
+  std::vector<uint32_t> work(roots.begin(), roots.end());
+  while(!work.empty()) {
+    uint32_t node = work.back();
+    work.pop_back();
+    if(marked[node]) continue;
+    marked[node] = true;
+    work.push_back(lo[node]);
+    work.push_back(hi[node]);
+  }
+  long freed = 0;
+  for(uint32_t node = 2; node < var.size(); node++) {
+    if(marked[node] || var[node] == BDD_FREE) continue;
+    std::vector<uint32_t> &bucket = unique[(uint64_t)lo[node] << 32 | hi[node]];
+    bucket.erase(std::find(bucket.begin(), bucket.end(), node));
+    var[node] = BDD_FREE;
+    freeList.push_back(node);
+    freed++;
+  }
+  live -= freed;
+  std::fill(cache.begin(), cache.end(), CacheEntry{BDD_TERMINAL, 0, 0, 0});
+  stats.collections++;
+  stats.freed += freed;
+}
+
+
+bool BddBitSolver::satisfiable(int assumption) {
+  uint32_t both = bdd.apply(Bdd::OP_AND, constraint, assumption);
+  return bdd.overflow || both != BDD_FALSE;
+}
+
+
+/// collect once the garbage is worth it; `roots` are the live literals
+void BddBitSolver::collect(const std::vector<int> &roots) {
+  if(bdd.live < BDD_GC_NODES) return;
+  std::vector<uint32_t> nodes(roots.begin(), roots.end());
+  nodes.push_back(constraint);
+  bdd.collect(nodes);
+}
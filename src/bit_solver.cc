@@ -0,0 +1,135 @@
+#include "ctrd_prop.h"
+#include "util.h"
+#include "kernel/satgen.h"
+#include "bit_solver.h"
+
+#ifdef CTRD_HAVE_Z3
+using namespace z3;
+#endif
+
+USING_YOSYS_NAMESPACE
+
+
+PRIVATE_NAMESPACE_BEGIN
+
+#ifdef CTRD_HAVE_Z3
+// Literals index into a table of Boolean expressions.
+struct Z3BitSolver : public BitSolver {
+  context c;
+  solver s;
+  std::vector<expr> lits;
+  int fresh = 0;
+
+  Z3BitSolver() : s(c) { }
+  int lit(const expr &e) {
+    lits.push_back(e);
+    return lits.size() - 1;
+  }
+  int lit_const(bool value) override { return lit(c.bool_val(value)); }
+  int lit_new() override { return lit(c.bool_const(("l" + std::to_string(fresh++)).c_str())); }
+  int lit_not(int a) override { return lit(!lits[a]); }
+  int lit_and(int a, int b) override { return lit(lits[a] && lits[b]); }
+  int lit_or(int a, int b) override { return lit(lits[a] || lits[b]); }
+  int lit_xor(int a, int b) override { return lit(lits[a] != lits[b]); }
+  int lit_iff(int a, int b) override { return lit(lits[a] == lits[b]); }
+  int lit_ite(int sel, int a, int b) override { return lit(ite(lits[sel], lits[a], lits[b])); }
+  void add(int a) override { s.add(lits[a]); }
+  bool satisfiable(int assumption) override {
+    expr_vector assumptions(c);
+    assumptions.push_back(lits[assumption]);
+    limit_query(s);
+    check_result result = s.check(assumptions);
+    if(result == unknown) unknowns++;
+    return result != unsat;
+  }
+};
+#endif
+
+
+// ezSAT literals and expressions are ints already; MiniSat does the
+// search. Every literal handed out may be used again by a later query,
+// so all of them are frozen against the simplifier.
+struct SatBitSolver : public BitSolver {
+  ezSatPtr ez;
+
+  int keep(int id) { return ez_keep(*ez, id); }
+  int lit_const(bool value) override { return value ? ezSAT::CONST_TRUE : ezSAT::CONST_FALSE; }
+  int lit_new() override { return keep(ez->literal()); }
+  int lit_not(int a) override { return keep(ez->NOT(a)); }
+  int lit_and(int a, int b) override { return keep(ez->AND(a, b)); }
+  int lit_or(int a, int b) override { return keep(ez->OR(a, b)); }
+  int lit_xor(int a, int b) override { return keep(ez->XOR(a, b)); }
+  int lit_iff(int a, int b) override { return keep(ez->IFF(a, b)); }
+  int lit_ite(int sel, int a, int b) override { return keep(ez->ITE(sel, a, b)); }
+  void add(int a) override { ez->assume(a); }
+  bool satisfiable(int assumption) override { return ez_solve(*ez, assumption, unknowns); }
+};
+
+PRIVATE_NAMESPACE_END
+
+
+/// Freeze `id` so the simplifier of ezMiniSAT keeps its variable for
+/// later solves, and return it.
+int ez_keep(ezSAT &ez, int id) {
+  if(id != ezSAT::CONST_TRUE && id != ezSAT::CONST_FALSE) ez.freeze(id);
+  return id;
+}
+
+
+/// Solve under what is left of the pass budget and the per-query timeout,
+/// which ezSAT counts in whole seconds. A solve that is skipped or runs
+/// out of time proves nothing and is added to `unknowns`. The timer is a
+/// process-wide alarm, so no two timed solves may run in one process at
+/// once; solve_clusters() gives timed ezSAT clusters processes of their
+/// own.
+bool ez_solve(ezSAT &ez, int assumption, int &unknowns) {
+  if(g_budget.exhausted()) {
+    unknowns++;
+    return true;
+  }
+  unsigned timeout = query_timeout();
+  if(timeout == 0) return ez.solve(assumption);
+  ez.setSolverTimeout((timeout + 999) / 1000);
+  bool sat = ez.solve(assumption);
+  if(!sat && ez.getSolverTimoutStatus()) {
+    unknowns++;
+    return true;
+  }
+  return sat;
+}
+
+
+const char* solver_name(SolverKind kind) {
+  return kind == SOLVER_SAT ? "sat" : kind == SOLVER_AIG ? "aig" : "z3";
+}
+
+
+/// the names parse_solver() accepts in this build
+const char* solver_names() {
+#ifdef CTRD_HAVE_Z3
+  return "z3, sat or aig";
+#else
+  return "sat or aig";
+#endif
+}
+
+
+bool parse_solver(const std::string &name, SolverKind &kind) {
+#ifdef CTRD_HAVE_Z3
+  if(name == "z3") kind = SOLVER_Z3;
+  else
+#endif
+  if(name == "sat") kind = SOLVER_SAT;
+  else if(name == "aig") kind = SOLVER_AIG;
+  else return false;
+  return true;
+}
+
+
+std::unique_ptr<BitSolver> make_bit_solver(SolverKind kind, AigStats &aigStats) {
+  if(kind == SOLVER_AIG) return make_aig_solver(aigStats);
+#ifdef CTRD_HAVE_Z3
+  if(kind == SOLVER_Z3) return std::unique_ptr<BitSolver>(new Z3BitSolver());
+#endif
+  return std::unique_ptr<BitSolver>(new SatBitSolver());
+}
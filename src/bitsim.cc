@@ -0,0 +1,332 @@
+#include "ctrd_prop.h"
+#include "util.h"
+#include "snapshot.h"
+#include "candidates.h"
+#include "bitsim.h"
+
+USING_YOSYS_NAMESPACE
+
+
+void SimStats::log_summary() const {
+  if(candidates == 0) return;
+  log("Simulated %ld patterns: disproved %d of %d candidates (%.1f%%) before the solver.\n",
+      patterns, disproved, candidates, 100.0 * disproved / candidates);
+}
+
+
+BitSim::BitSim(const SnapModule &sm, const std::vector<int> &cells)
+    : sm(sm), cells(cells), val(sm.numBits * SIM_WORDS, 0), pinned(sm.numBits, false) {
+  for(int w = 0; w < SIM_WORDS; w++) word(BIT_CONST1)[w] = ~0ull;
+}
+
+
+void BitSim::randomize(std::mt19937_64 &rng) {
+  for(int bit = BIT_CONSTX; bit < sm.numBits; bit++) {
+    if(pinned[bit]) continue;
+    uint64_t* w = word(bit);
+    for(int i = 0; i < SIM_WORDS; i++) w[i] = rng();
+  }
+}
+
+
+/// give `bits` the value patterns[p] in pattern p from now on
+void BitSim::pin(const std::vector<int> &bits, const std::vector<uint32_t> &patterns) {
+  for(size_t i = 0; i < bits.size(); i++) {
+    if(bits[i] <= BIT_CONSTX) continue;
+    pinned[bits[i]] = true;
+    uint64_t* w = word(bits[i]);
+    for(int k = 0; k < SIM_WORDS; k++) w[k] = 0;
+    for(int p = 0; p < SIM_PATTERNS; p++)
+      if((patterns[p] >> i) & 1) w[p / 64] |= 1ull << (p % 64);
+  }
+}
+
+
+/// whether some pattern gives `bit` the value `value`
+bool BitSim::takes(int bit, bool value) {
+  uint64_t* w = word(bit);
+  for(int i = 0; i < SIM_WORDS; i++)
+    if((value ? w[i] : ~w[i]) != 0) return true;
+  return false;
+}
+
+
+PRIVATE_NAMESPACE_BEGIN
+
+const uint64_t g_zero_words[SIM_WORDS] = {};
+
+struct WordOps {
+  BitSim &sim;
+
+  const uint64_t* in(BitRange sig, size_t i) {
+    return i < sig.size() ? sim.word(sig[i]) : g_zero_words;
+  }
+  uint64_t* out(BitRange sig, size_t i) {
+    static uint64_t discard[SIM_WORDS];
+    int bit = sig[i];
+    return (bit <= BIT_CONSTX || sim.pinned[bit]) ? discard : sim.word(bit);
+  }
+  void any(BitRange sig, uint64_t* r) {
+    for(int w = 0; w < SIM_WORDS; w++) r[w] = 0;
+    for(auto bit: sig) {
+      const uint64_t* a = sim.word(bit);
+      for(int w = 0; w < SIM_WORDS; w++) r[w] |= a[w];
+    }
+  }
+  void set_first(BitRange y, const uint64_t* r) {
+    for(size_t i = 0; i < y.size(); i++) {
+      uint64_t* o = out(y, i);
+      for(int w = 0; w < SIM_WORDS; w++) o[w] = i == 0 ? r[w] : 0;
+    }
+  }
+};
+
+PRIVATE_NAMESPACE_END
+
+
+void BitSim::run() {
+  WordOps ops{*this};
+  uint64_t r[SIM_WORDS], t[SIM_WORDS];
+  for(auto cell: cells) {
+    SnapOp op = sm.cellOp[cell];
+    if(op == OP_UNKNOWN || op == OP_INSTANCE) continue;
+    BitRange a = sm.cell_bits(cell, NAME_A);
+    BitRange b = sm.cell_bits(cell, NAME_B);
+    BitRange y = sm.cell_bits(cell, NAME_Y);
+    switch(op) {
+    case OP_NOT:
+      for(size_t i = 0; i < y.size(); i++) {
+        const uint64_t* ia = ops.in(a, i);
+        uint64_t* o = ops.out(y, i);
+        for(int w = 0; w < SIM_WORDS; w++) o[w] = ~ia[w];
+      }
+      break;
+    case OP_AND: case OP_OR: case OP_XOR: case OP_XNOR:
+      for(size_t i = 0; i < y.size(); i++) {
+        const uint64_t* ia = ops.in(a, i);
+        const uint64_t* ib = ops.in(b, i);
+        uint64_t* o = ops.out(y, i);
+        for(int w = 0; w < SIM_WORDS; w++)
+          o[w] = op == OP_AND ? ia[w] & ib[w] : op == OP_OR ? ia[w] | ib[w] :
+                 op == OP_XOR ? ia[w] ^ ib[w] : ~(ia[w] ^ ib[w]);
+      }
+      break;
+    case OP_REDUCE_AND:
+      for(int w = 0; w < SIM_WORDS; w++) r[w] = ~0ull;
+      for(auto bit: a)
+        for(int w = 0; w < SIM_WORDS; w++) r[w] &= word(bit)[w];
+      ops.set_first(y, r);
+      break;
+    case OP_REDUCE_OR: case OP_REDUCE_BOOL:
+      ops.any(a, r);
+      ops.set_first(y, r);
+      break;
+    case OP_REDUCE_XOR:
+      for(int w = 0; w < SIM_WORDS; w++) r[w] = 0;
+      for(auto bit: a)
+        for(int w = 0; w < SIM_WORDS; w++) r[w] ^= word(bit)[w];
+      ops.set_first(y, r);
+      break;
+    case OP_LOGIC_NOT:
+      ops.any(a, r);
+      for(int w = 0; w < SIM_WORDS; w++) r[w] = ~r[w];
+      ops.set_first(y, r);
+      break;
+    case OP_LOGIC_AND: case OP_LOGIC_OR:
+      ops.any(a, r);
+      ops.any(b, t);
+      for(int w = 0; w < SIM_WORDS; w++) r[w] = op == OP_LOGIC_AND ? r[w] & t[w] : r[w] | t[w];
+      ops.set_first(y, r);
+      break;
+    case OP_EQ: case OP_NE:
+      for(int w = 0; w < SIM_WORDS; w++) r[w] = ~0ull;
+      for(size_t i = 0; i < std::max(a.size(), b.size()); i++) {
+        const uint64_t* ia = ops.in(a, i);
+        const uint64_t* ib = ops.in(b, i);
+        for(int w = 0; w < SIM_WORDS; w++) r[w] &= ~(ia[w] ^ ib[w]);
+      }
+      if(op == OP_NE)
+        for(int w = 0; w < SIM_WORDS; w++) r[w] = ~r[w];
+      ops.set_first(y, r);
+      break;
+    case OP_MUX: {
+      const uint64_t* s = word(sm.cell_bits(cell, NAME_S)[0]);
+      for(size_t i = 0; i < y.size(); i++) {
+        const uint64_t* ia = ops.in(a, i);
+        const uint64_t* ib = ops.in(b, i);
+        uint64_t* o = ops.out(y, i);
+        for(int w = 0; w < SIM_WORDS; w++) o[w] = (ia[w] & ~s[w]) | (ib[w] & s[w]);
+      }
+      break;
+    }
+    case OP_PMUX: {
+      BitRange s = sm.cell_bits(cell, NAME_S);
+      ops.any(s, t);
+      size_t width = y.size();
+      for(size_t i = 0; i < width; i++) {
+        const uint64_t* ia = ops.in(a, i);
+        for(int w = 0; w < SIM_WORDS; w++) r[w] = ia[w] & ~t[w];
+        for(size_t j = 0; j < s.size(); j++) {
+          const uint64_t* sj = word(s[j]);
+          const uint64_t* bj = ops.in(b, j * width + i);
+          for(int w = 0; w < SIM_WORDS; w++) r[w] |= sj[w] & bj[w];
+        }
+        uint64_t* o = ops.out(y, i);
+        for(int w = 0; w < SIM_WORDS; w++) o[w] = r[w];
+      }
+      break;
+    }
+    default:
+      break;
+    }
+  }
+}
+
+
+/// cells in the fanin of `targets` that are not behind a stop bit, in
+/// topological order
+std::vector<int> fanin_cells(const SnapModule &sm, const std::vector<int> &targets,
+                             const std::vector<int> &stopBits) {
+  std::vector<int> driver(sm.numBits, -1);
+  for(int i = 0; i < sm.num_cells(); i++)
+    for(int j = sm.cellConn[i]; j < sm.cellConn[i + 1]; j++)
+      if(sm.connDir[j] & PORT_OUT)
+        for(auto bit: sm.conn_bits(j))
+          if(bit > BIT_CONSTX) driver[bit] = i;
+  for(auto bit: stopBits)
+    if(bit > BIT_CONSTX) driver[bit] = -1;
+
+  std::vector<bool> needed(sm.num_cells(), false);
+  std::vector<int> work(targets.begin(), targets.end());
+  while(!work.empty()) {
+    int cell = work.back();
+    work.pop_back();
+    if(needed[cell]) continue;
+    needed[cell] = true;
+    for(int j = sm.cellConn[cell]; j < sm.cellConn[cell + 1]; j++)
+      if(!(sm.connDir[j] & PORT_OUT))
+        for(auto bit: sm.conn_bits(j))
+          if(bit > BIT_CONSTX && driver[bit] >= 0) work.push_back(driver[bit]);
+  }
+  std::vector<int> cells;
+  for(auto cell: sm.order)
+    if(needed[cell]) cells.push_back(cell);
+  return cells;
+}
+
+
+/// Simulate random patterns that satisfy each group's value set and
+/// drop every candidate whose output is seen to take the value that
+/// would keep it from being tied.
+SimStats disprove_by_simulation(const NetSnapshot &snap) {
+  SimStats stats;
+  std::vector<CandidateGroup> groups = group_candidates(snap);
+  for(size_t g = 0; g < groups.size(); g++) {
+    const CandidateGroup &group = groups[g];
+    const SnapModule &sm = snap.modules[group.module];
+    std::vector<uint32_t> allowed;
+    for(uint32_t v = 0; v < group.values->size(); v++)
+      if((*group.values)[v]) allowed.push_back(v);
+    stats.candidates += group.candidates.size();
+    if(allowed.empty()) continue;
+
+    BitSim sim(sm, fanin_cells(sm, group.cells, group.root));
+    // a fixed seed keeps the netlist independent of the run
+    std::mt19937_64 rng(0x5eed + g);
+    std::vector<size_t> open;
+    for(size_t m = 0; m < group.cells.size(); m++) open.push_back(m);
+    std::vector<uint32_t> patterns(SIM_PATTERNS);
+    for(int round = 0; round < SIM_ROUNDS && !open.empty(); round++) {
+      for(auto &p: patterns) p = allowed[rng() % allowed.size()];
+      sim.randomize(rng);
+      sim.pin(group.root, patterns);
+      sim.run();
+      stats.patterns += SIM_PATTERNS;
+      std::vector<size_t> still;
+      for(auto m: open) {
+        int out = sm.cell_bits(group.cells[m], NAME_Y)[0];
+        // $eq is tied to 0 and $ne to 1, so seeing the other value ends it
+        if(sim.takes(out, !group.isNe[m])) {
+          g_check_vec[group.candidates[m]].verdict = VERDICT_VARIES;
+          stats.disproved++;
+        }
+        else still.push_back(m);
+      }
+      open = still;
+    }
+  }
+  stats.log_summary();
+  return stats;
+}
+
+
+PatternPool::PatternPool(const NetSnapshot &snap)
+    : snap(snap), groups(group_candidates(snap)), rng(0x5eed) {
+  sims.resize(groups.size());
+  pending.resize(groups.size());
+  open.resize(groups.size());
+  for(size_t g = 0; g < groups.size(); g++)
+    for(size_t m = 0; m < groups[g].candidates.size(); m++) {
+      groupOf[groups[g].candidates[m]] = g;
+      open[g].push_back(m);
+    }
+}
+
+
+/// group of a candidate, or -1 if it is not simulated
+int PatternPool::group_of(int candidate) const {
+  auto it = groupOf.find(candidate);
+  return it == groupOf.end() ? -1 : it->second;
+}
+
+
+void PatternPool::add(int group, uint32_t pattern) {
+  if(open[group].empty() || pending[group].size() >= SIM_PATTERNS) return;
+  pending[group].push_back(pattern);
+  recycled++;
+}
+
+
+/// simulate the pending patterns of a group and mark every open
+/// candidate they disprove
+void PatternPool::replay(int group) {
+  if(pending[group].empty()) return;
+  const CandidateGroup &cg = groups[group];
+  const SnapModule &sm = snap.modules[cg.module];
+  if(!sims[group])
+    sims[group].reset(new BitSim(sm, fanin_cells(sm, cg.cells, cg.root)));
+  BitSim &sim = *sims[group];
+  // repeat the counterexamples to fill every pattern slot
+  std::vector<uint32_t> patterns(SIM_PATTERNS);
+  for(int p = 0; p < SIM_PATTERNS; p++)
+    patterns[p] = pending[group][p % pending[group].size()];
+  pending[group].clear();
+  sim.randomize(rng);
+  sim.pin(cg.root, patterns);
+  sim.run();
+  replays++;
+  std::vector<size_t> still;
+  for(auto m: open[group]) {
+    int out = sm.cell_bits(cg.cells[m], NAME_Y)[0];
+    if(sim.takes(out, !cg.isNe[m])) {
+      g_check_vec[cg.candidates[m]].verdict = VERDICT_VARIES;
+      disproved++;
+    }
+    else still.push_back(m);
+  }
+  open[group] = still;
+}
+
+
+/// a candidate that was answered by the solver needs no more patterns
+void PatternPool::close(int candidate) {
+  int group = group_of(candidate);
+  if(group < 0) return;
+  const CandidateGroup &cg = groups[group];
+  std::vector<size_t> &members = open[group];
+  for(size_t i = 0; i < members.size(); i++)
+    if(cg.candidates[members[i]] == candidate) {
+      members.erase(members.begin() + i);
+      break;
+    }
+}
@@ -0,0 +1,56 @@
+#include "ctrd_prop.h"
+#include "util.h"
+#include "snapshot.h"
+#include "candidates.h"
+
+USING_YOSYS_NAMESPACE
+
+
+/// snapshot bits of a wire chunk, empty if the wire is not there
+std::vector<int> root_bits(const SnapModule &sm, RTLIL::SigSpec sig) {
+  if(!sig.is_chunk()) return std::vector<int>();
+  int wire = sm.find_wire(sig.as_chunk().wire->name.str());
+  if(wire < 0) return std::vector<int>();
+  BitRange wireBits = sm.wire_bits(wire);
+  int offset = sig.as_chunk().offset;
+  return std::vector<int>(wireBits.begin() + offset, wireBits.begin() + offset + sig.size());
+}
+
+
+/// Group the candidates without a verdict by instance path and the
+/// constrained signal they read. Signals without a value set are left
+/// out.
+std::vector<CandidateGroup> group_candidates(const NetSnapshot &snap) {
+  std::map<std::string, int> groupOf;
+  std::vector<CandidateGroup> groups;
+  for(size_t k = 0; k < g_check_vec.size(); k++) {
+    const CheckSet &set = g_check_vec[k];
+    if(!verdict_open(set.verdict) || !set.ctrdSig.is_chunk()) continue;
+    // the simulators and cluster solvers only handle equality
+    if(!set.cell->type.in(ID($eq), ID($ne))) continue;
+    std::string key = get_hier_name(set.ctrdSig, set.path) + ":" +
+                      toStr(set.ctrdSig.as_chunk().offset) + ":" + toStr(set.ctrdSig.size());
+    RTLIL::Module* module = set.cell->module;
+    int moduleId = snap.module_id(module);
+    if(moduleId < 0) continue;
+    const SnapModule &sm = snap.modules[moduleId];
+    if(groupOf.count(key) == 0) {
+      auto valuesIt = g_value_sets.find(get_hier_name(set.ctrdSig, set.path));
+      std::vector<int> root = root_bits(sm, set.ctrdSig);
+      if(valuesIt == g_value_sets.end() || root.empty() ||
+         valuesIt->second.size() != (1u << set.ctrdSig.size())) {
+        groupOf[key] = -1;
+        continue;
+      }
+      groupOf[key] = groups.size();
+      groups.push_back(CandidateGroup{moduleId, set.path, root, &valuesIt->second,
+                                      std::vector<int>(), std::vector<int>(), std::vector<bool>()});
+    }
+    if(groupOf[key] < 0) continue;
+    CandidateGroup &group = groups[groupOf[key]];
+    group.candidates.push_back(k);
+    group.cells.push_back(sm.cellIds.at(set.cell->name.str()));
+    group.isNe.push_back(set.cell->type == ID($ne));
+  }
+  return groups;
+}
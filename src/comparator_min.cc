@@ -0,0 +1,149 @@
+#include "ctrd_prop.h"
+#include "util.h"
+#include "netlist_edit.h"
+#include "comparator_min.h"
+
+USING_YOSYS_NAMESPACE
+
+
+void CompMinStats::log_summary() const {
+  if(comparators == 0) return;
+  log("Re-synthesized %d of %d comparators with don't-cares: %d -> %d literals.\n",
+      rewritten, comparators, literalsBefore, literalsAfter);
+}
+
+
+/// values the constrained signal can never take on the given path
+std::vector<uint32_t> impossible_values(FactOracle &oracle, RTLIL::SigSpec sig,
+                                        const std::string &path) {
+  std::vector<uint32_t> values;
+  int width = sig.size();
+  // a partial list is still sound once the budget runs out
+  for(uint32_t v = 0; v < (1u << width) && !g_budget.exhausted(); v++)
+    if(!oracle.possible({Pin{sig, path, v}})) values.push_back(v);
+  return values;
+}
+
+
+/// emit the sum of products `cover` over the bits of `in`
+RTLIL::SigSpec build_cover(ModIndex &idx, RTLIL::SigSpec in,
+                           const std::vector<Cube> &cover, bool invert) {
+  RTLIL::Module* module = idx.module;
+  auto new_wire = [&]() {
+    RTLIL::Wire* wire = module->addWire(NEW_ID);
+    idx.wires[wire->name] = wire;
+    return RTLIL::SigSpec(wire);
+  };
+  RTLIL::SigSpec terms;
+  for(auto &cube: cover) {
+    RTLIL::SigSpec bits;
+    std::vector<RTLIL::State> values;
+    for(int i = 0; i < in.size(); i++) {
+      if(!(cube.mask & (1u << i))) continue;
+      bits.append(in[i]);
+      values.push_back((cube.value & (1u << i)) ? RTLIL::State::S1 : RTLIL::State::S0);
+    }
+    if(bits.empty()) {
+      terms.append(RTLIL::SigSpec(RTLIL::State::S1));
+      continue;
+    }
+    if(bits.size() == 1 && values.front() == RTLIL::State::S1) {
+      terms.append(bits);
+      continue;
+    }
+    RTLIL::SigSpec term = new_wire();
+    if(bits.size() == 1)
+      idx.add_cell(module->addNot(NEW_ID, bits, term));
+    else
+      idx.add_cell(module->addEq(NEW_ID, bits, RTLIL::SigSpec(RTLIL::Const(values)), term));
+    terms.append(term);
+  }
+  RTLIL::SigSpec out;
+  if(terms.empty()) out = RTLIL::SigSpec(RTLIL::State::S0);
+  else if(terms.size() == 1) out = terms;
+  else {
+    out = new_wire();
+    idx.add_cell(module->addReduceOr(NEW_ID, terms, out));
+  }
+  if(invert) {
+    RTLIL::SigSpec inv = new_wire();
+    idx.add_cell(module->addNot(NEW_ID, out, inv));
+    out = inv;
+  }
+  return out;
+}
+
+
+/// Rebuild $eq/$ne comparators against a constant, treating the values
+/// the constrained signal can never take as don't-cares. Selects of
+/// $pmux decoders are such comparators, so they shrink as well.
+CompMinStats minimize_comparators(FactOracle &oracle, int maxWidth) {
+  CompMinStats stats;
+  std::map<std::string, std::vector<uint32_t>> cache;
+  std::vector<RTLIL::Cell*> order;
+  dict<RTLIL::Cell*, std::vector<const CheckSet*>> byCell;
+  for(auto &set: g_check_vec) {
+    if(g_edit_log.has_edit(set.cell) || !set.cell->type.in(ID($eq), ID($ne))) continue;
+    if(byCell.count(set.cell) == 0) order.push_back(set.cell);
+    byCell[set.cell].push_back(&set);
+  }
+
+  for(auto cell: order) {
+    const CheckSet &first = *byCell[cell].front();
+    RTLIL::SigSpec ctrdSig = first.ctrdSig;
+    int width = ctrdSig.size();
+    if(width < 2 || width > maxWidth || !ctrdSig.is_chunk()) continue;
+    if(first.forbidValue < 0 || first.forbidValue >= (1 << width)) continue;
+    RTLIL::Module* module = cell->module;
+    if(!all_paths_visited(module)) continue;
+    // the don't-cares below only cover the paths the cell was a
+    // candidate on, with this signal constrained
+    std::set<std::string> paths;
+    bool sameSig = true;
+    for(auto set: byCell[cell]) {
+      paths.insert(set->path);
+      if(set->ctrdSig != ctrdSig || set->forbidValue != first.forbidValue) sameSig = false;
+    }
+    if(!sameSig || paths != g_visited_paths[module]) continue;
+    stats.comparators++;
+
+    // a value is only free if no analysed instance can produce it
+    std::set<uint32_t> dc;
+    bool firstPath = true;
+    for(auto set: byCell[cell]) {
+      std::string key = get_hier_name(ctrdSig, set->path) + ":" +
+                        toStr(ctrdSig.as_chunk().offset) + ":" + toStr(width);
+      if(cache.count(key) == 0)
+        cache[key] = impossible_values(oracle, ctrdSig, set->path);
+      const auto &values = cache[key];
+      std::set<uint32_t> pathDc(values.begin(), values.end());
+      if(firstPath) dc = pathDc;
+      else {
+        std::set<uint32_t> both;
+        for(auto v: dc)
+          if(pathDc.count(v)) both.insert(v);
+        dc = both;
+      }
+      firstPath = false;
+    }
+    uint32_t value = first.forbidValue;
+    if(dc.count(value)) continue;
+
+    std::vector<Cube> cover = minimize_sop(width, std::vector<uint32_t>{value},
+                                           std::vector<uint32_t>(dc.begin(), dc.end()));
+    int literals = cover_literals(cover) + (cover.size() > 1 ? cover.size() : 0);
+    if(literals >= width) continue;
+
+    stats.rewritten++;
+    stats.literalsBefore += width;
+    stats.literalsAfter += literals;
+    bool invert = cell->type == ID($ne);
+    int outWidth = first.outSig.size();
+    g_edit_log.replace(cell, first.outSig, [ctrdSig, cover, invert, outWidth](ModIndex &idx) {
+      RTLIL::SigSpec out = build_cover(idx, ctrdSig, cover, invert);
+      out.extend_u0(outWidth);
+      return out;
+    });
+  }
+  return stats;
+}
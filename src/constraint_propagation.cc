@@ -22,13 +22,38 @@
 
 #include "ctrd_prop.h"
 #include "util.h"
+#include "netlist_edit.h"
+#include "mux_chain.h"
+#include "comparator_min.h"
+#include "decoder.h"
+#include "snapshot.h"
+#include "summary.h"
+#include "instance_prop.h"
+#include "partition.h"
+#include "bitsim.h"
+#include "value_enum.h"
+#include "bit_solver.h"
+#include "facts.h"
+#include "query_cache.h"
+#include "payoff.h"
+#include "shard.h"
+#ifdef CTRD_HAVE_Z3
+#include "query_dump.h"
+#include "portfolio.h"
+#include "pipeline.h"
+#include "session.h"
 
 using namespace z3;
+#endif
 
 USING_YOSYS_NAMESPACE
 PRIVATE_NAMESPACE_BEGIN
 
 
+void propagate_constraints(Design* design, RTLIL::Module* module, 
+                           const ModIndex &idx, RTLIL::SigSpec ctrdSig);
+
+
 void collect_eq(RTLIL::Cell* cell, RTLIL::SigSpec ctrdSig) {
   bool use_ctrd_sig = false;
   bool use_const = false;
@@ -53,61 +78,75 @@ void collect_eq(RTLIL::Cell* cell, RTLIL::SigSpec ctrdSig) {
   }
   if(use_ctrd_sig && use_const) {
     std::string path = get_path();
-    g_check_vec.push_back(CheckSet{path, cell, outputWire, ctrdSig, constValue});
-  }
-}
-
-
-void simplify_eq(solver &s, context &c, RTLIL::Module* module, 
-                 RTLIL::Cell* cell, RTLIL::SigSpec ctrdSig, int forbidValue) {
-  print_cell(cell);
-  bool use_ctrd_sig = false;
-  bool use_forbid_value = false;
-  RTLIL::SigSpec outputWire;
-  RTLIL::IdString outputPort;
-  for(auto &conn: cell->connections_) {
-    RTLIL::IdString port = conn.first;
-    RTLIL::SigSpec connSig = conn.second;
-    print_sigspec(connSig);
-    if(cell->input(port)) {
-      if(connSig.is_wire() && connSig == ctrdSig) {
-        use_ctrd_sig = true;
-      }
-      else if(connSig.is_fully_const()) {
-        int eqValue = connSig.as_int();
-        use_forbid_value = eqValue == forbidValue;
-      }
+    int verdict = -1;
+    auto it = g_value_sets.find(get_hier_name(ctrdSig, path));
+    if(g_options.parallel)
+      verdict = sim_verdict(path, cell);
+    // recognized decoders are answered in closed form, once per module
+    // and value set
+    if(verdict < 0 && it != g_value_sets.end())
+      verdict = decoder_verdict(cell, it->second);
+    // any other comparator against a constant is a lookup in the value
+    // set
+    if(verdict < 0 && it != g_value_sets.end()) {
+      std::vector<uint32_t> values;
+      for(uint32_t v = 0; v < it->second.size(); v++)
+        if(it->second[v]) values.push_back(v);
+      verdict = lookup_verdict(CheckSet{path, cell, outputWire, ctrdSig, constValue, -1}, values);
     }
-    else {
-      assert(cell->output(port));
-      outputWire = connSig;
-      outputPort = port;
-    }
-  }
-  // replace the eq with constant false
-  if(use_ctrd_sig && use_forbid_value) {
-    module->remove(cell);
-    //cell->connections_[outputPort] = RTLIL::SigSpec();
-    // connect the output wire to always false
-    module->connect(outputWire, RTLIL::SigSpec(false));
+    g_check_vec.push_back(CheckSet{path, cell, outputWire, ctrdSig, constValue, verdict});
+#ifdef CTRD_HAVE_Z3
+    if(verdict < 0 && g_pipeline) g_pipeline->submit(g_check_vec.size() - 1);
+#endif
   }
 }
 
 
-void add_submod(solver &s, context &c, RTLIL::Design* design, RTLIL::Module* module, 
-                RTLIL::Cell* cell, RTLIL::SigSpec ctrdSig) {
-   RTLIL::SigSpec port = get_cell_port(ctrdSig, cell);
+void add_submod(RTLIL::Design* design, RTLIL::Module* module, 
+                const ModIndex &idx, RTLIL::Cell* cell, RTLIL::SigSpec ctrdSig) {
+   RTLIL::IdString port = get_cell_port(idx, ctrdSig, cell);
    if(port.empty()) return;
    auto subMod = get_subModule(design, cell);
-   DriveMap_t mp;
-   get_drive_map(subMod, mp);
-   propagate_constraints(s, c, design, subMod, mp, port);
+   const ModIndex &subIdx = get_mod_index(subMod);
+   RTLIL::SigSpec portSig = get_port_sigspec(subIdx, port);
+   if(portSig.empty()) return;
+   std::string outerPath = get_path();
+   auto valuesIt = g_value_sets.find(get_hier_name(ctrdSig));
+   // A summarized child gives port facts and output value sets from its
+   // transfer table instead of a walk. Its path still counts as visited;
+   // the rewrites inside a module want a proof on every path, and none
+   // is recorded for this one, so they leave the module alone.
+   if(g_options.summaries && valuesIt != g_value_sets.end() &&
+      consult_summary(cell, subMod, port, ctrdSig, valuesIt->second)) {
+     enter_instance(cell);
+     g_visited_paths[subMod].insert(get_path());
+     leave_instance();
+     return;
+   }
+   enter_instance(cell);
+   std::string innerPath = get_path();
+   // the port inside the instance carries the same value as the
+   // constrained signal outside it
+   if(portSig.size() == ctrdSig.size())
+     add_fact(Fact{FACT_EQ, ctrdSig, outerPath, portSig, innerPath, 0, 0, cell, {{outerPath, module}, {innerPath, subMod}}});
+   if(valuesIt != g_value_sets.end() && portSig.size() == ctrdSig.size())
+     g_value_sets[get_hier_name(portSig)] = valuesIt->second;
+   propagate_constraints(design, subMod, subIdx, portSig);
+   leave_instance();
+   // tie the instance outputs to the wires they drive outside, so that
+   // facts proven inside reach the logic reading them
+   for(auto &conn: cell->connections_) {
+     if(!cell->output(conn.first) || !conn.second.is_wire()) continue;
+     RTLIL::SigSpec innerSig = get_port_sigspec(subIdx, conn.first);
+     if(innerSig.size() != conn.second.size()) continue;
+     add_fact(Fact{FACT_EQ, innerSig, innerPath, conn.second, outerPath, 0, 0, cell, {{outerPath, module}, {innerPath, subMod}}});
+   }
 }
 
 
-void add_and(solver &s, context &c, RTLIL::Design* design, RTLIL::Module* module, 
-             DriveMap_t &mp, RTLIL::Cell* cell, RTLIL::SigSpec ctrdSig) {
-  RTLIL::SigSpec port = get_cell_port(ctrdSig, cell);
+void add_and(RTLIL::Design* design, RTLIL::Module* module, 
+             const ModIndex &idx, RTLIL::Cell* cell, RTLIL::SigSpec ctrdSig) {
+  RTLIL::IdString port = get_cell_port(idx, ctrdSig, cell);
   if(port.empty()) return;
   RTLIL::SigSpec outputConnSig;
   bool const_arg = false;
@@ -125,32 +164,73 @@ void add_and(solver &s, context &c, RTLIL::Design* design, RTLIL::Module* module
   }
   if(const_arg) {
     assert(equal_width(ctrdSig, outputConnSig));
-    expr ctrdExpr = get_expr(c, ctrdSig);
-    expr outExpr = get_expr(c, outputConnSig);
-    s.add((ctrdExpr & const_value) == outExpr);
-    propagate_constraints(s, c, design, module, mp, outputConnSig);
+    add_fact(Fact{FACT_AND, ctrdSig, get_path(), outputConnSig, get_path(), (uint32_t)const_value, 0, cell, {{get_path(), module}}});
+    auto valuesIt = g_value_sets.find(get_hier_name(ctrdSig));
+    if(valuesIt != g_value_sets.end()) {
+      ValueSet_t values(valuesIt->second.size(), false);
+      for(uint32_t v = 0; v < values.size(); v++)
+        if(valuesIt->second[v]) values[v & const_value] = true;
+      g_value_sets[get_hier_name(outputConnSig)] = values;
+    }
+    propagate_constraints(design, module, idx, outputConnSig);
   }
 }
 
 
-void get_drive_map(RTLIL::Module* module, DriveMap_t &mp) {
-  for(auto cellPair: module->cells_) {
-    RTLIL::Cell* cell = cellPair.second;
-    for(auto pair: cell->connections_) {
-      auto portId = pair.first;
-      auto connSig = pair.second;
-      if(mp.find(connSig) == mp.end())
-        mp.emplace(connSig, DestGroup{std::set<RTLIL::SigSpec>{}, std::set<RTLIL::Cell*>{cell}});
-      else
-        mp[connSig].cells.insert(cell);
-    }
-  }
+// Everything a propagation handler needs about the module being walked.
+struct PropCtx {
+  Design* design;
+  RTLIL::Module* module;
+  const ModIndex &idx;
+};
+
+
+typedef void (*Handler_t)(PropCtx &ctx, RTLIL::Cell* cell, RTLIL::SigSpec ctrdSig);
+
+
+template<CellKind K>
+void handle_cell(PropCtx &, RTLIL::Cell*, RTLIL::SigSpec) { }
+
+template<>
+void handle_cell<CK_EQ>(PropCtx &, RTLIL::Cell* cell, RTLIL::SigSpec ctrdSig) {
+  collect_eq(cell, ctrdSig);
+}
+
+template<>
+void handle_cell<CK_NE>(PropCtx &, RTLIL::Cell* cell, RTLIL::SigSpec ctrdSig) {
+  collect_eq(cell, ctrdSig);
+}
+
+template<>
+void handle_cell<CK_LT>(PropCtx &, RTLIL::Cell* cell, RTLIL::SigSpec ctrdSig) {
+  collect_eq(cell, ctrdSig);
+}
+
+template<>
+void handle_cell<CK_AND>(PropCtx &ctx, RTLIL::Cell* cell, RTLIL::SigSpec ctrdSig) {
+  add_and(ctx.design, ctx.module, ctx.idx, cell, ctrdSig);
 }
 
+template<>
+void handle_cell<CK_SUBMOD>(PropCtx &ctx, RTLIL::Cell* cell, RTLIL::SigSpec ctrdSig) {
+  add_submod(ctx.design, ctx.module, ctx.idx, cell, ctrdSig);
+}
+
+
+// indexed by CellKind, so the loop below does no type comparisons
+const Handler_t g_handlers[CK_COUNT] = {
+  handle_cell<CK_OTHER>,
+  handle_cell<CK_EQ>,
+  handle_cell<CK_NE>,
+  handle_cell<CK_LT>,
+  handle_cell<CK_AND>,
+  handle_cell<CK_SUBMOD>
+};
+
 
 /// Recursively propagate constraints through the design
-void propagate_constraints(solver &s, context &c, Design* design, RTLIL::Module* module, 
-                           DriveMap_t &mp, RTLIL::SigSpec ctrdSig)
+void propagate_constraints(Design* design, RTLIL::Module* module, 
+                           const ModIndex &idx, RTLIL::SigSpec ctrdSig)
                            //std::string ctrdSig, int offset, int length, uint32_t forbidValue)
 {
   // traverse all connections
@@ -163,53 +243,480 @@ void propagate_constraints(solver &s, context &c, Design* design, RTLIL::Module*
   //    g_work_list.push(std::make_pair(dstSig, forbidValue));
   //  }
   //}
-  std::cout << "=== Begin a new module:"  << std::endl;
-  print_module(module);
+  g_visited_paths[module].insert(get_path());
   // traverse all cells
-  assert(mp.find(ctrdSig) != mp.end());
-  const auto group = mp[ctrdSig];
-  assert(group.wires.empty());
-  auto connectedCells = group.cells;
-
-  for(auto cell: connectedCells) {
-    print_module(cell->module);
-    if(cell->type == ID($eq)) 
-      collect_eq(cell, ctrdSig);
-    else if(cell_is_module(design, cell))
-      add_submod(s, c, design, module, cell, ctrdSig);
-    else if(cell->type == ID($and))
-      add_and(s, c, design, module, mp, cell, ctrdSig);
+  std::vector<int> connectedCells = idx.cell_ids(ctrdSig);
+
+  PropCtx ctx{design, module, idx};
+  for(auto id: connectedCells)
+    g_handlers[idx.kind(id)](ctx, idx.cell(id), ctrdSig);
+}
+
+
+#ifdef CTRD_HAVE_Z3
+/// turn a satisfying assignment into one simulation pattern per group
+void recycle_model(const model &m, PatternPool &pool, const std::vector<expr> &rootExprs) {
+  for(size_t g = 0; g < rootExprs.size(); g++) {
+    if(pool.open[g].empty()) continue;
+    expr value = m.eval(rootExprs[g], true);
+    if(value.is_bool()) pool.add(g, value.is_true() ? 1 : 0);
+    else if(value.is_numeral()) pool.add(g, value.get_numeral_uint());
+  }
+}
+
+
+// The final check on Z3. Queries about a candidate may be raced and
+// dumped, and every counterexample they find is replayed on the
+// candidates still waiting for a query.
+struct CandidateOracle : public Z3FactOracle {
+  PatternPool &pool;
+  std::vector<expr> rootExprs;
+  QueryDumper dumper;
+  PortfolioStats portfolioStats;
+  dict<RTLIL::Cell*, int> coneSizes;
+  int candidate = -1;
+
+  CandidateOracle(solver &s, context &c, PatternPool &pool);
+  int cone_of(RTLIL::Cell* cell);
+  void focus(int k, int shard) override;
+  check_result check() override;
+  void log_summary() const override;
+};
+
+
+CandidateOracle::CandidateOracle(solver &s, context &c, PatternPool &pool) : Z3FactOracle(s, c), pool(pool) {
+  if(g_options.simulate)
+    for(auto &group: pool.groups) {
+      const CheckSet &first = g_check_vec[group.candidates.front()];
+      rootExprs.push_back(get_expr(c, first.ctrdSig, first.path));
+    }
+  if(!g_options.dumpDir.empty()) dumper.open(g_options.dumpDir);
+}
+
+
+int CandidateOracle::cone_of(RTLIL::Cell* cell) {
+  if(!coneSizes.count(cell)) coneSizes[cell] = cone_size(g_snapshot, cell);
+  return coneSizes.at(cell);
+}
+
+
+void CandidateOracle::focus(int k, int shard) {
+  candidate = k;
+  if(shard >= 0) dumper.prefix = "p" + std::to_string(shard) + "_";
+}
+
+
+check_result CandidateOracle::check() {
+  if(candidate < 0) return Z3FactOracle::check();
+  const CheckSet &set = g_check_vec[candidate];
+  check_result result;
+  bool raced = g_options.portfolio && cone_of(set.cell) >= g_options.portfolioMinCone;
+  if(raced) result = race_query(s, portfolioStats);
+  else {
+    if(g_options.portfolio) portfolioStats.skipped++;
+    result = Z3FactOracle::check();
+  }
+  if(dumper.is_open()) dumper.dump(s, set, cone_of(set.cell), result);
+  // a raced answer leaves no model in `s`
+  if(result == sat && !raced && !rootExprs.empty()) recycle_model(s.get_model(), pool, rootExprs);
+  return result;
+}
+
+
+void CandidateOracle::log_summary() const {
+  portfolioStats.log_summary();
+  if(dumper.is_open())
+    log("Dumped %d queries to %s.\n", dumper.count, dumper.dir.c_str());
+}
+#endif
+
+
+/// how much of the estimated payoff the first tenth of the order holds
+void log_payoffs(const std::vector<Payoff> &payoffs, const std::vector<int> &ranked) {
+  long total = 0, head = 0;
+  size_t tenth = (ranked.size() + 9) / 10;
+  for(size_t i = 0; i < ranked.size(); i++) {
+    total += payoffs[ranked[i]].score();
+    if(i < tenth) head += payoffs[ranked[i]].score();
+  }
+  if(total > 0)
+    log("Ranked %d candidates by payoff: the first %d hold %ld of %ld points.\n",
+        (int)ranked.size(), (int)tenth, head, total);
+}
+
+
+/// Add the relation between every candidate's output and its
+/// constrained signal to the facts. It holds in the netlist, so later
+/// stages can rely on it too. Returns which candidates could be
+/// modelled.
+std::vector<bool> assert_relations() {
+  std::vector<bool> modelled(g_check_vec.size(), false);
+  for(size_t k = 0; k < g_check_vec.size(); k++) {
+    const CheckSet &set = g_check_vec[k];
+    modelled[k] = compare_modelled(set.cell, set.ctrdSig);
+    if(modelled[k])
+      add_fact(Fact{FACT_COMPARE, set.ctrdSig, set.path, set.outSig, set.path,
+                    (uint32_t)set.forbidValue, 0, set.cell, {{set.path, set.cell->module}}});
   }
+  return modelled;
 }
 
 
-void simplify(solver &s, context &c) {
-  for(auto set: g_check_vec) {
+/// Answer the candidates of `shard` (all of them if it is negative) in
+/// payoff order: the constant output of each on its path, or -1.
+/// Narrow signals compared by several candidates have their values
+/// enumerated once and the candidates answered by lookup. Shard workers
+/// do not log.
+std::vector<int> decide_candidates(FactOracle &oracle, PatternPool &pool, const std::vector<int> &ranked,
+                                   const std::vector<bool> &modelled,
+                                   const std::vector<int> &shardOf, int shard) {
+  std::vector<int> values(g_check_vec.size(), -1);
+  int queries = 0, closedForm = 0, simulated = 0, clusterSat = 0;
+  // unknown answers and skipped queries leave the cell alone
+  int unknowns = 0, outOfBudget = 0;
+
+  EnumStats enumStats;
+  // queries the open candidates of each signal would cost on their own
+  std::map<std::string, int> queriesPerSignal;
+  for(size_t k = 0; k < g_check_vec.size(); k++) {
+    const CheckSet &set = g_check_vec[k];
+    if(verdict_open(set.verdict) && modelled[k] && (shard < 0 || shardOf[k] == shard))
+      queriesPerSignal[get_hier_name(set.ctrdSig, set.path)] += is_ordered_compare(set.cell) ? 2 : 1;
+  }
+  std::map<std::string, std::vector<uint32_t>> reachable;
+  std::set<std::string> enumerated;
+
+  for(auto k: ranked) {
+    if(shard >= 0 && shardOf[k] != shard) continue;
+    const CheckSet &set = g_check_vec[k];
     std::string path = set.path;
     auto cell = set.cell;
-    RTLIL::SigSpec outSig = set.outSig;
     RTLIL::SigSpec ctrdSig = set.ctrdSig;
-    auto module = cell->module;
-    int forbidValue = set.forbidValue;
-    expr outExpr = get_expr(c, outSig, path);
-    expr ctrdExpr = get_expr(c, ctrdSig, path);
-    s.push();
-    s.add(outExpr == (ctrdExpr == forbidValue));
-    if(s.check() == unsat) {
-      module->remove(cell);
-      module->connect(outSig, RTLIL::SigSpec(false));
+    std::string sigName = get_hier_name(ctrdSig, path);
+    int group = g_options.simulate ? pool.group_of(k) : -1;
+    if(group >= 0) pool.replay(group);
+
+    int value = -1;
+    if(set.verdict == VERDICT_VARIES) simulated++;
+    else if(set.verdict >= 0) {
+      closedForm++;
+      value = set.verdict;
+    }
+    else if(modelled[k] && g_budget.exhausted()) outOfBudget++;
+    else if(modelled[k]) {
+      // the cluster solver saw only the cone of its cluster, so the
+      // global check may still prove the candidate
+      if(set.verdict == VERDICT_CLUSTER_SAT) clusterSat++;
+      oracle.focus(k, shard);
+      int width = ctrdSig.size();
+      // at most one check per value plus the final unsat one, so it
+      // never costs more than the queries it replaces
+      if(width <= ENUM_MAX_WIDTH && (1 << width) + 1 <= queriesPerSignal[sigName] &&
+         !enumerated.count(sigName)) {
+        enumerated.insert(sigName);
+        std::vector<uint32_t> reached;
+        if(oracle.enumerate(ctrdSig, path, 1u << width, reached, enumStats.checks)) {
+          reachable[sigName] = reached;
+          enumStats.signals++;
+          enumStats.values += reached.size();
+        }
+        else enumStats.aborted++;
+      }
+      if(reachable.count(sigName)) {
+        value = lookup_verdict(set, reachable[sigName]);
+        enumStats.answered++;
+      }
+      else {
+        // $eq can only be tied to 0 and $ne to 1; ordered compares
+        // are tried both ways
+        std::vector<int> tries;
+        if(cell->type == ID($eq)) tries = {0};
+        else if(cell->type == ID($ne)) tries = {1};
+        else tries = {0, 1};
+        for(auto t: tries) {
+          queries++;
+          int before = oracle.unknowns;
+          bool possible = oracle.possible({Pin{set.outSig, path, (uint32_t)!t}});
+          unknowns += oracle.unknowns - before;
+          if(!possible) {
+            value = t;
+            break;
+          }
+        }
+      }
+      oracle.focus(-1, shard);
+      pool.close(k);
     }
-    s.pop();
+    values[k] = value;
+  }
+  if(shard >= 0) return values;
+
+  log("Checked %d candidates: %d solver queries, %d answered in closed form, "
+      "%d disproved by simulation, %d left open by the cluster solvers.\n", (int)g_check_vec.size(),
+      queries + enumStats.checks, closedForm, simulated, clusterSat);
+  enumStats.log_summary();
+  oracle.log_summary();
+  if(unknowns > 0)
+    log("%d queries hit the per-query limit and were treated as unprovable.\n", unknowns);
+  if(outOfBudget > 0)
+    log_warning("Time budget exhausted: %d candidates were not checked.\n", outOfBudget);
+  if(pool.recycled > 0)
+    log("Replayed %d counterexamples in %d simulations: %d candidates dropped without a query.\n",
+        pool.recycled, pool.replays, pool.disproved);
+  return values;
+}
+
+
+/// Candidates are tried in payoff order, so a run that is cut short
+/// has the largest savings first. With -procs the candidates are split
+/// over forked workers. A comparator is only rewritten if every instance
+/// path of its module was analysed and it was a candidate with the same
+/// constant output on each of them.
+void simplify(FactOracle &oracle, PatternPool &pool, const std::vector<bool> &modelled) {
+  std::vector<Payoff> payoffs = estimate_payoffs(g_snapshot);
+  std::vector<int> ranked = payoff_order(payoffs);
+  log_payoffs(payoffs, ranked);
+
+  std::vector<int> values;
+  if(g_options.procs > 1) {
+    // the workers inherit the encoded facts
+    oracle.sync();
+    std::vector<int> shardOf = assign_shards(ranked, g_options.procs);
+    ShardStats shardStats;
+    values = run_sharded(g_options.procs, shardOf, [&](int shard) {
+      return decide_candidates(oracle, pool, ranked, modelled, shardOf, shard);
+    }, shardStats);
+    shardStats.log_summary();
+  }
+  else values = decide_candidates(oracle, pool, ranked, modelled, std::vector<int>(), -1);
+
+  std::vector<RTLIL::Cell*> order;
+  // the output a cell has on every path, -1 once that fails, and the
+  // paths it was a candidate on
+  dict<RTLIL::Cell*, int> tieValue;
+  dict<RTLIL::Cell*, RTLIL::SigSpec> outputs;
+  dict<RTLIL::Cell*, std::set<std::string>> tiePaths;
+  for(auto k: ranked) {
+    auto cell = g_check_vec[k].cell;
+    if(tieValue.count(cell) == 0) {
+      order.push_back(cell);
+      tieValue[cell] = values[k];
+      outputs[cell] = g_check_vec[k].outSig;
+    }
+    else if(tieValue[cell] != values[k]) tieValue[cell] = -1;
+    tiePaths[cell].insert(g_check_vec[k].path);
+  }
+  for(auto cell: order) {
+    if(tieValue[cell] < 0) continue;
+    // a path that reached the module through another signal proved
+    // nothing about the cell
+    if(!all_paths_visited(cell->module) || tiePaths[cell] != g_visited_paths[cell->module]) continue;
+    g_edit_log.tie_const(cell, outputs[cell], RTLIL::Const(tieValue[cell] ? RTLIL::State::S1 : RTLIL::State::S0));
   }
 }
 
 
 struct ConstraintPropagatePass : public Pass {
   ConstraintPropagatePass() : Pass("opt_ctrd", "constraint propagation pass") { }
-  void execute(std::vector<std::string>, Design* design) override { 
+  void help() override {
+    log("\n");
+    log("    opt_ctrd [options]\n");
+    log("\n");
+    log("Propagate a constraint on a top-level input through the hierarchy and\n");
+    log("remove the logic it makes constant. The pass always works on the whole\n");
+    log("hierarchy below the top module and takes no selection.\n");
+    log("\n");
+    log("    -summaries\n");
+    log("        summarize every module bottom-up first, tie instance outputs\n");
+    log("        that their summaries prove constant and answer instances from\n");
+    log("        their summaries instead of walking into them.\n");
+    log("\n");
+    log("    -parallel\n");
+    log("        first propagate the constraint through every instance on a\n");
+    log("        work-stealing thread pool and answer the comparators it settles\n");
+    log("        without the solver.\n");
+    log("\n");
+    log("    -clusters\n");
+    log("        split the fanout cone of each constrained signal into connected\n");
+    log("        components and solve them in parallel, one solver each.\n");
+    log("        Candidates whose cone reads at most 20 bits are decided on BDDs.\n");
+    log("\n");
+    log("    -nosim\n");
+    log("        do not try to disprove candidates by random simulation before\n");
+    log("        the solver sees them.\n");
+    log("\n");
+    log("    -solver z3|sat|aig\n");
+    log("        backend of the final check, the rewrites that follow it and the\n");
+    log("        cluster encoder (default: z3, or sat in a build without Z3).\n");
+    log("        sat bit-blasts the facts into Yosys's ezSAT with MiniSat; aig\n");
+    log("        builds a structurally hashed and-inverter graph first and hands\n");
+    log("        it to ezSAT incrementally. Both imply -clusters. -session,\n");
+    log("        -pipeline, -portfolio and -dump-queries need z3.\n");
+    log("\n");
+    log("    -cache <file>\n");
+    log("        keep the answers of cluster queries in a memory-mapped file and\n");
+    log("        reuse them in later runs. Queries are keyed by a structural\n");
+    log("        hash of their cone and constraint. Several processes may share\n");
+    log("        the file. Implies -clusters.\n");
+    log("\n");
+    log("    -cache-size <entries>\n");
+    log("        number of entries of a new cache file (default: 1048576); the\n");
+    log("        least recently used entries are evicted once it is full.\n");
+    log("\n");
+    log("    -dump-queries <dir>\n");
+    log("        write every solver query of the final check as a standalone\n");
+    log("        SMT-LIB file to <dir>, for replay with opt_ctrd_replay.\n");
+    log("\n");
+    log("    -timeout <ms>\n");
+    log("        give up on a single solver query after this long and leave its\n");
+    log("        cell untouched (default: no limit).\n");
+    log("\n");
+    log("    -rlimit <N>\n");
+    log("        Z3 resource limit per query, a deterministic alternative to\n");
+    log("        -timeout. The ezSAT backends only honour -timeout, rounded up\n");
+    log("        to whole seconds, and -budget.\n");
+    log("\n");
+    log("    -budget <seconds>\n");
+    log("        wall-clock budget of the pass. Once it is spent no further\n");
+    log("        queries are made and what has been proven so far is committed.\n");
+    log("\n");
+    log("    -portfolio\n");
+    log("        race hard final queries on several Z3 configurations in parallel\n");
+    log("        threads and keep the first answer. Queries whose candidate has\n");
+    log("        a fanin of fewer than 256 cells are solved directly.\n");
+    log("\n");
+    log("    -portfolio-min-cone <N>\n");
+    log("        like -portfolio, but race every query whose candidate has a\n");
+    log("        fanin of at least N cells.\n");
+    log("\n");
+    log("    -procs <N>\n");
+    log("        split the final check over N forked worker processes. Each\n");
+    log("        worker inherits the solver copy-on-write and sends back one\n");
+    log("        verdict per candidate.\n");
+    log("\n");
+    log("    -pipeline\n");
+    log("        hand candidates to solver threads while propagation is still\n");
+    log("        running, through a bounded queue that holds propagation back\n");
+    log("        when the solvers fall behind. Reports the time to the first\n");
+    log("        answer and the candidate throughput.\n");
+    log("\n");
+    log("    -session\n");
+    log("        keep the solver alive for later runs with -session. Facts from\n");
+    log("        modules whose contents did not change are reused, the others\n");
+    log("        are encoded anew. opt_ctrd_flush releases the solver.\n");
+    log("\n");
+    log("    -threads <N>\n");
+    log("        number of threads for -summaries, -parallel, -clusters and\n");
+    log("        -pipeline (default: all hardware threads).\n");
+    log("\n");
+  }
+  void execute(std::vector<std::string> args, Design* design) override { 
     log_header(design, "Executing the new OPT_CONSTRAINT pass\n");
-    context c;
-    solver s(c);
+    g_options = CtrdOptions();
+    size_t argidx;
+    for(argidx = 1; argidx < args.size(); argidx++) {
+      if(args[argidx] == "-summaries") {
+        g_options.summaries = true;
+        continue;
+      }
+      if(args[argidx] == "-parallel") {
+        g_options.parallel = true;
+        continue;
+      }
+      if(args[argidx] == "-clusters") {
+        g_options.clusters = true;
+        continue;
+      }
+      if(args[argidx] == "-nosim") {
+        g_options.simulate = false;
+        continue;
+      }
+      if(args[argidx] == "-solver" && argidx + 1 < args.size()) {
+        if(!parse_solver(args[++argidx], g_options.solver))
+          log_cmd_error("Unknown solver %s, expected %s.\n", args[argidx].c_str(), solver_names());
+        if(g_options.solver != SOLVER_Z3) g_options.clusters = true;
+        continue;
+      }
+      if(args[argidx] == "-cache" && argidx + 1 < args.size()) {
+        g_options.cacheFile = args[++argidx];
+        g_options.clusters = true;
+        continue;
+      }
+      if(args[argidx] == "-cache-size" && argidx + 1 < args.size()) {
+        g_options.cacheEntries = std::max(QCACHE_PROBES, atoi(args[++argidx].c_str()));
+        continue;
+      }
+      if(args[argidx] == "-dump-queries" && argidx + 1 < args.size()) {
+        g_options.dumpDir = args[++argidx];
+        continue;
+      }
+      if(args[argidx] == "-timeout" && argidx + 1 < args.size()) {
+        g_options.timeout = atoi(args[++argidx].c_str());
+        continue;
+      }
+      if(args[argidx] == "-rlimit" && argidx + 1 < args.size()) {
+        g_options.rlimit = atoi(args[++argidx].c_str());
+        continue;
+      }
+      if(args[argidx] == "-budget" && argidx + 1 < args.size()) {
+        g_options.budget = atof(args[++argidx].c_str());
+        continue;
+      }
+      if(args[argidx] == "-portfolio") {
+        g_options.portfolio = true;
+        continue;
+      }
+      if(args[argidx] == "-portfolio-min-cone" && argidx + 1 < args.size()) {
+        g_options.portfolioMinCone = std::max(0, atoi(args[++argidx].c_str()));
+        g_options.portfolio = true;
+        continue;
+      }
+      if(args[argidx] == "-procs" && argidx + 1 < args.size()) {
+        g_options.procs = atoi(args[++argidx].c_str());
+        continue;
+      }
+      if(args[argidx] == "-pipeline") {
+        g_options.pipeline = true;
+        continue;
+      }
+      if(args[argidx] == "-session") {
+        g_options.session = true;
+        continue;
+      }
+      if(args[argidx] == "-threads" && argidx + 1 < args.size()) {
+        g_options.threads = atoi(args[++argidx].c_str());
+        continue;
+      }
+      break;
+    }
+    // instances are walked from the top, so a partial selection would
+    // leave paths unvisited
+    extra_args(args, argidx, design, false);
+    // these work on the Z3 solver of the final check
+    std::vector<std::string> z3Only;
+    if(g_options.session) z3Only.push_back("-session");
+    if(g_options.pipeline) z3Only.push_back("-pipeline");
+    if(g_options.portfolio) z3Only.push_back("-portfolio");
+    if(!g_options.dumpDir.empty()) z3Only.push_back("-dump-queries");
+#ifdef CTRD_HAVE_Z3
+    if(!z3Only.empty() && g_options.solver != SOLVER_Z3)
+      log_cmd_error("Option %s needs -solver z3.\n", z3Only.front().c_str());
+#else
+    if(!z3Only.empty())
+      log_cmd_error("Option %s needs a build with Z3.\n", z3Only.front().c_str());
+#endif
+    g_budget.begin(g_options.budget);
+#ifdef CTRD_HAVE_Z3
+    std::unique_ptr<context> ownContext;
+    std::unique_ptr<solver> ownSolver;
+    if(g_options.session) g_session.begin(design);
+    else {
+      ownContext.reset(new context);
+      ownSolver.reset(new solver(*ownContext));
+    }
+    context &c = g_options.session ? *g_session.c : *ownContext;
+    solver &s = g_options.session ? *g_session.s : *ownSolver;
+#endif
     // Iterate through all modules in the design
     RTLIL::Module* module = design->top_module();
     // Recursively propagate constants through the module
@@ -217,12 +724,86 @@ struct ConstraintPropagatePass : public Pass {
     int shift = 0;
     int length = 8;
     uint32_t forbidValue = 1;
-    RTLIL::SigSpec inputSig = get_sigspec(module, inputName, shift, length);
-    add_neq_ctrd(s, c, inputSig, forbidValue);
-    DriveMap_t mp;
-    get_drive_map(module, mp);
-    propagate_constraints(s, c, design, module, mp, inputSig);
-    simplify(s, c);
+    g_mod_index.clear();
+    enumerate_instance_paths(module);
+    const ModIndex &idx = get_mod_index(module);
+    RTLIL::SigSpec inputSig = get_sigspec(idx, inputName, shift, length);
+    if(inputSig.empty())
+      log_cmd_error("Constrained signal %s[%d:%d] not found in module %s.\n", inputName.c_str(),
+                    shift + length - 1, shift, log_id(module->name));
+    // worker threads only ever see this copy of the design
+    g_snapshot.build(design);
+    if(g_options.summaries)
+      build_summaries(g_snapshot, g_options.threads);
+    add_neq_ctrd(module, inputSig, forbidValue);
+    auto topValues = g_value_sets.find(get_hier_name(inputSig));
+    if(g_options.parallel && topValues != g_value_sets.end())
+      propagate_instances(g_snapshot, module, inputSig, topValues->second, g_options.threads);
+#ifdef CTRD_HAVE_Z3
+    SolvePipeline pipeline(s, c);
+    if(g_options.pipeline) {
+      g_pipeline = &pipeline;
+      pipeline.begin(g_options.threads);
+    }
+#endif
+    propagate_constraints(design, module, idx, inputSig);
+#ifdef CTRD_HAVE_Z3
+    if(g_pipeline) {
+      pipeline.finish();
+      g_pipeline = nullptr;
+    }
+#endif
+    if(g_options.simulate)
+      disprove_by_simulation(g_snapshot);
+    if(g_options.clusters)
+      solve_clusters(g_snapshot, g_options.threads, g_options.solver);
+    std::vector<bool> modelled = assert_relations();
+    PatternPool pool(g_snapshot);
+    // the final check and the rewrites after it ask the -solver backend
+    AigStats aigStats;
+    std::unique_ptr<FactOracle> oracle;
+#ifdef CTRD_HAVE_Z3
+    if(g_options.solver == SOLVER_Z3) oracle.reset(new CandidateOracle(s, c, pool));
+    else
+#endif
+    oracle.reset(new BitFactOracle(g_options.solver, aigStats));
+    simplify(*oracle, pool, modelled);
+    int tableTies = tie_decoder_tables();
+    if(tableTies > 0)
+      log("Tied %d decoder case tables in closed form.\n", tableTies);
+    int portTies = apply_port_facts();
+    if(g_options.summaries)
+      log("Tied %d instance outputs from module summaries.\n", portTies);
+    CompMinStats cmpStats = minimize_comparators(*oracle, 6);
+    EditStats stats = g_edit_log.commit();
+    stats.log_summary();
+    cmpStats.log_summary();
+    // a rewrite inside a module is only safe if every instance of it
+    // was analysed
+    MuxChainStats muxStats;
+    for(auto &pair: g_visited_paths) {
+      if(g_budget.exhausted()) break;
+      if(!all_paths_visited(pair.first)) continue;
+      muxStats.add(collapse_mux_chains(*oracle, get_mod_index(pair.first), pair.second));
+    }
+    muxStats.log_summary();
+    // the AIG backend reports its node counts once it is gone
+    oracle.reset();
+    aigStats.log_summary();
+#ifdef CTRD_HAVE_Z3
+    if(g_options.session) g_session.end();
+    g_expr_map.clear();
+#endif
+    clear_facts();
+    g_check_vec.clear();
+    g_visited_paths.clear();
+    g_value_sets.clear();
+    g_mod_index.clear();
+    g_instance_paths.clear();
+    g_summaries.clear();
+    g_snapshot.clear();
+    g_sim_verdicts.clear();
+    clear_decoder_cache();
   }
 } ConstraintPropagatePass;
 
@@ -0,0 +1,191 @@
+#include "ctrd_prop.h"
+#include "util.h"
+#include "netlist_edit.h"
+#include "decoder.h"
+
+USING_YOSYS_NAMESPACE
+
+PRIVATE_NAMESPACE_BEGIN
+
+dict<RTLIL::Module*, DecoderInfo> g_decoder_info;
+std::map<std::pair<RTLIL::Module*, ValueSet_t>, DecoderResult> g_decoder_results;
+
+
+DecoderInfo classify(RTLIL::Module* module) {
+  DecoderInfo info;
+  RTLIL::Wire* input = nullptr;
+  std::vector<RTLIL::Cell*> pmuxes;
+  std::set<uint32_t> eqConstants;
+  bool onlyEq = true;
+  for(auto cellPair: module->cells_) {
+    RTLIL::Cell* cell = cellPair.second;
+    if(cell->type == ID($pmux)) {
+      if(!cell->getPort(ID::A).is_fully_const() || !cell->getPort(ID::B).is_fully_const())
+        return DecoderInfo();
+      pmuxes.push_back(cell);
+      continue;
+    }
+    if(!cell->type.in(ID($eq), ID($ne)) || cell->getPort(ID::Y).size() != 1)
+      return DecoderInfo();
+    RTLIL::SigSpec a = cell->getPort(ID::A);
+    RTLIL::SigSpec b = cell->getPort(ID::B);
+    if(a.is_fully_const()) std::swap(a, b);
+    if(!a.is_wire() || !b.is_fully_const()) return DecoderInfo();
+    RTLIL::Wire* wire = a.as_wire();
+    if(!wire->port_input || (input != nullptr && input != wire)) return DecoderInfo();
+    input = wire;
+    uint32_t value = b.as_int();
+    if(cell->type == ID($eq)) {
+      // repeated constants would make the outputs overlap
+      if(eqConstants.count(value)) return DecoderInfo();
+      eqConstants.insert(value);
+    }
+    else onlyEq = false;
+    info.compares.push_back(cell);
+    info.constants.push_back(value);
+  }
+  if(input == nullptr || input->width > MAX_VALUE_SET_WIDTH) return DecoderInfo();
+
+  // every table select must come straight from one of the comparators
+  pool<RTLIL::SigBit> compareOutputs;
+  for(auto cell: info.compares)
+    compareOutputs.insert(cell->getPort(ID::Y)[0]);
+  for(auto pmux: pmuxes)
+    for(auto bit: pmux->getPort(ID::S))
+      if(!compareOutputs.count(bit)) return DecoderInfo();
+
+  info.input = input->name;
+  info.width = input->width;
+  info.tables = pmuxes;
+  if(!pmuxes.empty()) info.kind = DEC_CASE_TABLE;
+  else if(onlyEq && (int)eqConstants.size() == (1 << info.width)) info.kind = DEC_ONE_HOT;
+  else info.kind = DEC_COMPARE_FAN;
+  return info;
+}
+
+
+bool compare_holds(RTLIL::Cell* cell, uint32_t constant, uint32_t value) {
+  bool eq = constant == value;
+  return cell->type == ID($eq) ? eq : !eq;
+}
+
+
+DecoderResult evaluate(const DecoderInfo &info, const ValueSet_t &values) {
+  DecoderResult result;
+  std::vector<uint32_t> possible;
+  for(uint32_t v = 0; v < values.size(); v++)
+    if(values[v]) possible.push_back(v);
+
+  dict<RTLIL::SigBit, int> compareOf;
+  for(size_t i = 0; i < info.compares.size(); i++) {
+    RTLIL::Cell* cell = info.compares[i];
+    compareOf[cell->getPort(ID::Y)[0]] = i;
+    bool canHold = false, canFail = false;
+    for(auto v: possible) {
+      if(compare_holds(cell, info.constants[i], v)) canHold = true;
+      else canFail = true;
+    }
+    result.compares.push_back(canHold && canFail ? -1 : canHold ? 1 : 0);
+  }
+
+  for(auto pmux: info.tables) {
+    RTLIL::SigSpec sel = pmux->getPort(ID::S);
+    int width = pmux->getParam(ID::WIDTH).as_int();
+    RTLIL::Const out;
+    bool first = true, constant = true;
+    for(auto v: possible) {
+      int hot = -1, hits = 0;
+      for(int j = 0; j < sel.size(); j++) {
+        int i = compareOf.at(sel[j]);
+        if(compare_holds(info.compares[i], info.constants[i], v)) {
+          hot = j;
+          hits++;
+        }
+      }
+      if(hits > 1) {
+        constant = false;
+        break;
+      }
+      RTLIL::Const entry = hits == 0 ? pmux->getPort(ID::A).as_const()
+                                     : pmux->getPort(ID::B).extract(hot * width, width).as_const();
+      if(first) out = entry;
+      else if(!(out == entry)) {
+        constant = false;
+        break;
+      }
+      first = false;
+    }
+    result.tables.push_back(constant && !first ? out : RTLIL::Const());
+  }
+  return result;
+}
+
+PRIVATE_NAMESPACE_END
+
+
+/// classify a module once per pass run
+const DecoderInfo& get_decoder_info(RTLIL::Module* module) {
+  auto it = g_decoder_info.find(module);
+  if(it != g_decoder_info.end()) return it->second;
+  g_decoder_info[module] = classify(module);
+  return g_decoder_info[module];
+}
+
+
+/// closed-form outputs of a decoder for one set of input values
+const DecoderResult& get_decoder_result(RTLIL::Module* module, const ValueSet_t &values) {
+  auto key = std::make_pair(module, values);
+  auto it = g_decoder_results.find(key);
+  if(it != g_decoder_results.end()) return it->second;
+  g_decoder_results[key] = evaluate(get_decoder_info(module), values);
+  return g_decoder_results[key];
+}
+
+
+/// output of a decoder comparator under the value set, or -1
+int decoder_verdict(RTLIL::Cell* cell, const ValueSet_t &values) {
+  const DecoderInfo &info = get_decoder_info(cell->module);
+  if(info.kind == DEC_NONE || values.size() != (1u << info.width)) return -1;
+  auto pos = std::find(info.compares.begin(), info.compares.end(), cell);
+  if(pos == info.compares.end()) return -1;
+  const DecoderResult &result = get_decoder_result(cell->module, values);
+  return result.compares[pos - info.compares.begin()];
+}
+
+
+/// Tie the $pmux tables of case-table decoders whose output is the same
+/// constant on every instance path. Returns the number of tables tied.
+int tie_decoder_tables() {
+  int tied = 0;
+  for(auto &pair: g_visited_paths) {
+    RTLIL::Module* module = pair.first;
+    const DecoderInfo &info = get_decoder_info(module);
+    if(info.kind != DEC_CASE_TABLE || !all_paths_visited(module)) continue;
+    RTLIL::SigSpec input(module->wire(info.input));
+    std::vector<const DecoderResult*> results;
+    for(auto &path: pair.second) {
+      auto it = g_value_sets.find(get_hier_name(input, path));
+      if(it == g_value_sets.end() || it->second.size() != (1u << info.width)) break;
+      results.push_back(&get_decoder_result(module, it->second));
+    }
+    if(results.size() != pair.second.size()) continue;
+    for(size_t i = 0; i < info.tables.size(); i++) {
+      RTLIL::Cell* pmux = info.tables[i];
+      const RTLIL::Const &out = results.front()->tables[i];
+      if(out.size() == 0 || g_edit_log.has_edit(pmux)) continue;
+      bool agree = true;
+      for(auto result: results)
+        if(!(result->tables[i] == out)) agree = false;
+      if(!agree) continue;
+      g_edit_log.tie_const(pmux, pmux->getPort(ID::Y), out);
+      tied++;
+    }
+  }
+  return tied;
+}
+
+
+void clear_decoder_cache() {
+  g_decoder_info.clear();
+  g_decoder_results.clear();
+}
@@ -0,0 +1,223 @@
+#include "ctrd_prop.h"
+#include "util.h"
+#include "value_enum.h"
+#include "bit_solver.h"
+#ifdef CTRD_HAVE_Z3
+#include "session.h"
+#endif
+#include "facts.h"
+
+#ifdef CTRD_HAVE_Z3
+using namespace z3;
+#endif
+
+USING_YOSYS_NAMESPACE
+
+std::vector<Fact> g_facts;
+
+
+void add_fact(const Fact &fact) {
+  g_facts.push_back(fact);
+}
+
+
+/// try every value of a narrow signal on its own
+bool FactOracle::enumerate(RTLIL::SigSpec sig, const std::string &path, size_t limit,
+                           std::vector<uint32_t> &values, int &checks) {
+  values.clear();
+  int width = sig.size();
+  if(width > MAX_VALUE_SET_WIDTH) return false;
+  int before = unknowns;
+  for(uint32_t v = 0; v < (1u << width); v++) {
+    checks++;
+    if(possible({Pin{sig, path, v}})) values.push_back(v);
+    if(values.size() > limit) return false;
+  }
+  return unknowns == before;
+}
+
+
+PRIVATE_NAMESPACE_BEGIN
+
+/// the comparator's relation as one literal, compared at 32 bits like
+/// compare_expr()
+int compare_lit(BitSolver &s, RTLIL::Cell* cell, RTLIL::SigSpec ctrdSig,
+                const std::vector<int> &bits, uint32_t constant) {
+  bool ctrdIsA = cell->getPort(ID::A) == ctrdSig;
+  // a < b and a == b, from the least significant bit up
+  int lt = s.lit_const(false), eq = s.lit_const(true);
+  for(size_t i = 0; i < 32; i++) {
+    int value = i < bits.size() ? bits[i] : s.lit_const(false);
+    int k = s.lit_const((constant >> i) & 1);
+    int a = ctrdIsA ? value : k, b = ctrdIsA ? k : value;
+    int same = s.lit_iff(a, b);
+    lt = s.lit_or(s.lit_and(s.lit_not(a), b), s.lit_and(same, lt));
+    eq = s.lit_and(eq, same);
+  }
+  if(cell->type == ID($eq)) return eq;
+  if(cell->type == ID($ne)) return s.lit_not(eq);
+  if(cell->type == ID($lt)) return lt;
+  if(cell->type == ID($le)) return s.lit_or(lt, eq);
+  if(cell->type == ID($gt)) return s.lit_not(s.lit_or(lt, eq));
+  return s.lit_not(lt);
+}
+
+PRIVATE_NAMESPACE_END
+
+
+BitFactOracle::BitFactOracle(SolverKind kind, AigStats &aigStats) : s(make_bit_solver(kind, aigStats)) { }
+
+
+/// literals of `sig` on `path`, one per bit of the whole wire
+std::vector<int> BitFactOracle::bits(RTLIL::SigSpec sig, const std::string &path) {
+  auto chunk = sig.as_chunk();
+  std::vector<int> &wire = wires[get_hier_name(sig, path)];
+  while((int)wire.size() < chunk.wire->width) wire.push_back(s->lit_new());
+  return std::vector<int>(wire.begin() + chunk.offset, wire.begin() + chunk.offset + sig.size());
+}
+
+
+int BitFactOracle::equals(const std::vector<int> &bits, uint32_t value) {
+  int r = s->lit_const(true);
+  for(size_t i = 0; i < bits.size(); i++) {
+    bool one = i < 32 && ((value >> i) & 1);
+    r = s->lit_and(r, one ? bits[i] : s->lit_not(bits[i]));
+  }
+  return r;
+}
+
+
+void BitFactOracle::encode(const Fact &fact) {
+  std::vector<int> a = bits(fact.a, fact.pathA);
+  switch(fact.kind) {
+  case FACT_EQ: {
+    std::vector<int> b = bits(fact.b, fact.pathB);
+    for(size_t i = 0; i < a.size() && i < b.size(); i++) s->add(s->lit_iff(a[i], b[i]));
+    break;
+  }
+  case FACT_AND: {
+    std::vector<int> b = bits(fact.b, fact.pathB);
+    for(size_t i = 0; i < a.size() && i < b.size(); i++) {
+      bool kept = i < 32 && ((fact.value >> i) & 1);
+      s->add(kept ? s->lit_iff(a[i], b[i]) : s->lit_not(b[i]));
+    }
+    break;
+  }
+  case FACT_NE_CONST:
+    s->add(s->lit_not(equals(a, fact.value)));
+    break;
+  case FACT_IMPLIES:
+    s->add(s->lit_or(s->lit_not(equals(a, fact.value)), equals(bits(fact.b, fact.pathB), fact.value2)));
+    break;
+  case FACT_COMPARE: {
+    int out = bits(fact.b, fact.pathB)[0];
+    s->add(s->lit_iff(out, compare_lit(*s, fact.cell, fact.a, a, fact.value)));
+    break;
+  }
+  }
+}
+
+
+void BitFactOracle::sync() {
+  for(; encoded < g_facts.size(); encoded++) encode(g_facts[encoded]);
+}
+
+
+bool BitFactOracle::possible(const std::vector<Pin> &pins) {
+  sync();
+  int assumption = s->lit_const(true);
+  for(auto &pin: pins) assumption = s->lit_and(assumption, equals(bits(pin.sig, pin.path), pin.value));
+  int before = s->unknowns;
+  bool result = s->satisfiable(assumption);
+  unknowns += s->unknowns - before;
+  return result;
+}
+
+
+#ifdef CTRD_HAVE_Z3
+PRIVATE_NAMESPACE_BEGIN
+
+// facts before this one are in the solver already
+size_t g_synced = 0;
+
+expr as_bv(context &c, const expr &e) {
+  return e.is_bool() ? ite(e, c.bv_val(1, 1), c.bv_val(0, 1)) : e;
+}
+
+PRIVATE_NAMESPACE_END
+
+
+expr fact_expr(context &c, const Fact &fact) {
+  expr a = wire_expr(c, fact.a, fact.pathA);
+  int width = fact.a.size();
+  if(fact.kind == FACT_NE_CONST) return as_bv(c, a) != c.bv_val(fact.value, width);
+  expr b = wire_expr(c, fact.b, fact.pathB);
+  switch(fact.kind) {
+  case FACT_EQ:
+    if(a.is_bool() || b.is_bool()) return as_bool(c, a) == as_bool(c, b);
+    return a == b;
+  case FACT_AND:
+    return (as_bv(c, a) & c.bv_val(fact.value, width)) == as_bv(c, b);
+  case FACT_IMPLIES:
+    return implies(as_bv(c, a) == c.bv_val(fact.value, width),
+                   as_bv(c, b) == c.bv_val(fact.value2, fact.b.size()));
+  default: {
+    expr cmpExpr = c.bool_val(true);
+    compare_expr(c, fact.cell, fact.a, a, fact.value, cmpExpr);
+    return as_bool(c, b) == cmpExpr;
+  }
+  }
+}
+
+
+expr pin_expr(context &c, const Pin &pin) {
+  expr e = wire_expr(c, pin.sig, pin.path);
+  if(e.is_bool()) return pin.value ? e : !e;
+  return e == c.bv_val(pin.value, pin.sig.size());
+}
+
+
+void sync_facts(solver &s, context &c) {
+  if(g_session.running) g_session.visit();
+  for(; g_synced < g_facts.size(); g_synced++)
+    assert_fact(s, fact_expr(c, g_facts[g_synced]), g_facts[g_synced].about);
+}
+
+
+void Z3FactOracle::sync() {
+  sync_facts(s, c);
+}
+
+
+bool Z3FactOracle::possible(const std::vector<Pin> &pins) {
+  sync();
+  s.push();
+  for(auto &pin: pins) s.add(pin_expr(c, pin));
+  check_result result = check();
+  s.pop();
+  if(result == unknown) unknowns++;
+  return result != unsat;
+}
+
+
+check_result Z3FactOracle::check() {
+  limit_query(s);
+  return s.check();
+}
+
+
+/// block each value as the solver finds it, instead of one query per value
+bool Z3FactOracle::enumerate(RTLIL::SigSpec sig, const std::string &path, size_t limit,
+                             std::vector<uint32_t> &values, int &checks) {
+  sync();
+  return enumerate_values(s, wire_expr(c, sig, path), sig.size(), limit, values, checks);
+}
+#endif
+
+
+void clear_facts() {
+  g_facts.clear();
+#ifdef CTRD_HAVE_Z3
+  g_synced = 0;
+#endif
+}
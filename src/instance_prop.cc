@@ -0,0 +1,122 @@
+#include "ctrd_prop.h"
+#include "util.h"
+#include "snapshot.h"
+#include "summary.h"
+#include "scheduler.h"
+#include "instance_prop.h"
+
+USING_YOSYS_NAMESPACE
+
+std::map<std::pair<std::string, std::string>, int> g_sim_verdicts;
+
+
+PRIVATE_NAMESPACE_BEGIN
+
+struct TaskRunner {
+  const NetSnapshot &snap;
+  TaskScheduler &sched;
+  // one result list per worker, merged after the run
+  std::vector<std::vector<SimVerdict>> results;
+
+  void run(int worker, const PropTask &task);
+  void spawn(int worker, PropTask task) {
+    sched.spawn(worker, [this, task](int w) { run(w, task); });
+  }
+};
+
+
+/// Simulate the module once per allowed value. Comparators that come
+/// out the same every time are results; instance inputs that stay known
+/// become tasks of their own.
+void TaskRunner::run(int worker, const PropTask &task) {
+  const SnapModule &sm = snap.modules[task.module];
+  int numCells = sm.num_cells();
+  // -2 not seen yet, -1 differs between values
+  std::vector<int> compares(numCells, -2);
+  std::map<int, ValueSet_t> childSets;
+  std::set<int> unknownConns;
+  for(int cell = 0; cell < numCells; cell++) {
+    if(sm.cellOp[cell] != OP_INSTANCE) continue;
+    for(int j = sm.cellConn[cell]; j < sm.cellConn[cell + 1]; j++) {
+      int width = sm.conn_bits(j).size();
+      if(sm.connDir[j] == PORT_IN && width > 0 && width <= MAX_VALUE_SET_WIDTH)
+        childSets[j] = ValueSet_t(1 << width, false);
+    }
+  }
+
+  for(uint32_t v = 0; v < task.values.size(); v++) {
+    if(!task.values[v]) continue;
+    std::vector<Tern> val = ternary_simulate(snap, sm, task.port, v, g_summaries);
+    for(int cell = 0; cell < numCells; cell++) {
+      if(sm.cellOp[cell] != OP_EQ && sm.cellOp[cell] != OP_NE) continue;
+      Tern t = val[sm.cell_bits(cell, NAME_Y)[0]];
+      int out = t == TX ? -1 : t == T1 ? 1 : 0;
+      if(compares[cell] == -2) compares[cell] = out;
+      else if(compares[cell] != out) compares[cell] = -1;
+    }
+    for(auto &pair: childSets) {
+      if(unknownConns.count(pair.first)) continue;
+      uint32_t inValue = 0;
+      BitRange bits = sm.conn_bits(pair.first);
+      for(size_t i = 0; i < bits.size(); i++) {
+        if(val[bits[i]] == TX) unknownConns.insert(pair.first);
+        if(val[bits[i]] == T1) inValue |= 1u << i;
+      }
+      pair.second[inValue] = true;
+    }
+  }
+
+  for(int cell = 0; cell < numCells; cell++)
+    if(compares[cell] >= 0)
+      results[worker].push_back(SimVerdict{task.path, sm.cellName[cell], compares[cell]});
+
+  for(int cell = 0; cell < numCells; cell++) {
+    if(sm.cellOp[cell] != OP_INSTANCE) continue;
+    std::string path = task.path.empty() ? sm.cellName[cell] : task.path + "." + sm.cellName[cell];
+    for(int j = sm.cellConn[cell]; j < sm.cellConn[cell + 1]; j++) {
+      if(!childSets.count(j) || unknownConns.count(j)) continue;
+      const ValueSet_t &values = childSets.at(j);
+      // a port that can take every value carries no constraint
+      if(std::find(values.begin(), values.end(), false) == values.end()) continue;
+      spawn(worker, PropTask{path, sm.cellChild[cell], j - sm.cellConn[cell], values});
+    }
+  }
+}
+
+PRIVATE_NAMESPACE_END
+
+
+/// Propagate the value set of a top-level input port through every
+/// instance below it on a work-stealing pool. The verdicts are sorted
+/// before they are stored, so they do not depend on the thread count.
+void propagate_instances(const NetSnapshot &snap, RTLIL::Module* top, RTLIL::SigSpec sig,
+                         const ValueSet_t &values, int threads) {
+  g_sim_verdicts.clear();
+  int module = snap.module_id(top);
+  if(module < 0 || !sig.is_wire() || !sig.as_wire()->port_input) {
+    log("Parallel propagation needs a whole input port; skipped.\n");
+    return;
+  }
+  int port = snap.port_id(module, sig.as_wire()->name.str());
+
+  TaskScheduler sched(threads);
+  TaskRunner runner{snap, sched, std::vector<std::vector<SimVerdict>>(sched.threads())};
+  runner.spawn(-1, PropTask{"", module, port, values});
+  sched.run();
+
+  std::vector<SimVerdict> merged;
+  for(auto &list: runner.results)
+    merged.insert(merged.end(), list.begin(), list.end());
+  std::sort(merged.begin(), merged.end());
+  for(auto &verdict: merged)
+    g_sim_verdicts.insert(std::make_pair(std::make_pair(verdict.path, verdict.cell), verdict.value));
+  sched.stats().log_summary(sched.threads());
+  log("Parallel propagation settled %d comparators.\n", (int)g_sim_verdicts.size());
+}
+
+
+/// output of a comparator found by parallel propagation, or -1
+int sim_verdict(const std::string &path, RTLIL::Cell* cell) {
+  auto it = g_sim_verdicts.find(std::make_pair(path, cell->name.str()));
+  return it == g_sim_verdicts.end() ? -1 : it->second;
+}
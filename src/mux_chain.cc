@@ -0,0 +1,177 @@
+#include "ctrd_prop.h"
+#include "util.h"
+#include "mux_chain.h"
+
+USING_YOSYS_NAMESPACE
+
+
+void MuxChainStats::add(const MuxChainStats &other) {
+  chains += other.chains;
+  muxes += other.muxes;
+  pmuxes += other.pmuxes;
+  droppedCases += other.droppedCases;
+  depthBefore += other.depthBefore;
+  depthAfter += other.depthAfter;
+}
+
+
+void MuxChainStats::log_summary() const {
+  if(chains == 0) return;
+  log("Collapsed %d mux chains: %d $mux cells became %d $pmux cells, %d cases dropped.\n",
+      chains, muxes, pmuxes, droppedCases);
+  log("Mux depth on the collapsed chains: %d -> %d levels.\n", depthBefore, depthAfter);
+}
+
+
+PRIVATE_NAMESPACE_BEGIN
+
+// the $mux whose output feeds only the A input of `mux`, if any
+RTLIL::Cell* next_link(const ModIndex &idx, RTLIL::Cell* mux) {
+  RTLIL::SigSpec a = mux->getPort(ID::A);
+  auto drivers = idx.drivers(a);
+  if(drivers.size() != 1) return nullptr;
+  RTLIL::Cell* next = *drivers.begin();
+  if(next->type != ID($mux) || next->getPort(ID::Y) != a) return nullptr;
+  for(auto bit: a) {
+    if(idx.liveBits.count(bit)) return nullptr;
+    for(auto &ref: idx.ports(bit))
+      if(ref.cell != next && (ref.cell != mux || ref.port != ID::A)) return nullptr;
+  }
+  return next;
+}
+
+
+// true if `cond` cannot hold on any of the instance paths
+bool never_holds(FactOracle &oracle, const std::vector<std::vector<Pin>> &cond) {
+  for(auto &pins: cond)
+    if(oracle.possible(pins)) return false;
+  return true;
+}
+
+PRIVATE_NAMESPACE_END
+
+
+/// find maximal chains of $mux cells linked through their A inputs
+std::vector<MuxChain> find_mux_chains(const ModIndex &idx) {
+  std::vector<RTLIL::Cell*> muxes;
+  pool<RTLIL::Cell*> inner;
+  for(auto cellPair: idx.module->cells_) {
+    RTLIL::Cell* cell = cellPair.second;
+    if(cell->type != ID($mux)) continue;
+    muxes.push_back(cell);
+    RTLIL::Cell* next = next_link(idx, cell);
+    if(next != nullptr) inner.insert(next);
+  }
+  std::vector<MuxChain> chains;
+  for(auto head: muxes) {
+    if(inner.count(head)) continue;
+    MuxChain chain;
+    pool<RTLIL::Cell*> seen;
+    for(RTLIL::Cell* mux = head; mux != nullptr && !seen.count(mux); mux = next_link(idx, mux)) {
+      seen.insert(mux);
+      chain.muxes.push_back(mux);
+      chain.selects.push_back(mux->getPort(ID::S));
+      chain.cases.push_back(mux->getPort(ID::B));
+      chain.fallback = mux->getPort(ID::A);
+    }
+    if(chain.muxes.size() >= 2) chains.push_back(chain);
+  }
+  return chains;
+}
+
+
+/// Rebuild each chain from the facts the solver has learned: selects
+/// that can never be set are dropped, and runs of pairwise exclusive
+/// selects become a single $pmux. A $pmux counts as one select level.
+MuxChainStats collapse_mux_chains(FactOracle &oracle, ModIndex &idx,
+                                  const std::set<std::string> &paths) {
+  MuxChainStats stats;
+  RTLIL::Module* module = idx.module;
+  for(auto &chain: find_mux_chains(idx)) {
+    int n = chain.muxes.size();
+    // one condition per path, each a single pin
+    std::vector<std::vector<std::vector<Pin>>> sels(n);
+    bool encodable = true;
+    for(int i = 0; i < n; i++) {
+      if(chain.selects[i].size() != 1 || !chain.selects[i].is_chunk()) {
+        encodable = false;
+        break;
+      }
+      for(auto &path: paths)
+        sels[i].push_back({Pin{chain.selects[i], path, 1}});
+    }
+    if(!encodable) continue;
+
+    std::vector<int> live;
+    for(int i = 0; i < n; i++)
+      if(!never_holds(oracle, sels[i])) live.push_back(i);
+
+    // greedily grow runs of selects that exclude each other
+    std::vector<std::vector<int>> segments;
+    for(int i: live) {
+      bool exclusive = !segments.empty();
+      if(exclusive) {
+        for(int j: segments.back()) {
+          std::vector<std::vector<Pin>> both;
+          for(size_t p = 0; p < sels[i].size(); p++)
+            both.push_back({sels[i][p][0], sels[j][p][0]});
+          if(!never_holds(oracle, both)) {
+            exclusive = false;
+            break;
+          }
+        }
+      }
+      if(exclusive) segments.back().push_back(i);
+      else segments.push_back(std::vector<int>{i});
+    }
+    if((int)segments.size() == n) continue;
+
+    RTLIL::SigSpec headY = chain.muxes.front()->getPort(ID::Y);
+    int width = headY.size();
+    int pmuxes = 0;
+    std::vector<RTLIL::SigSpec> outputs;
+    for(size_t k = 0; k < segments.size(); k++) {
+      if(k == 0) {
+        outputs.push_back(headY);
+        continue;
+      }
+      RTLIL::Wire* wire = module->addWire(NEW_ID, width);
+      idx.wires[wire->name] = wire;
+      outputs.push_back(RTLIL::SigSpec(wire));
+    }
+    for(auto mux: chain.muxes) {
+      idx.remove_cell(mux);
+      module->remove(mux);
+    }
+    if(segments.empty()) {
+      module->connect(headY, chain.fallback);
+      idx.add_live(headY);
+      idx.add_live(chain.fallback);
+    }
+    for(size_t k = 0; k < segments.size(); k++) {
+      RTLIL::SigSpec a = k + 1 < segments.size() ? outputs[k + 1] : chain.fallback;
+      RTLIL::Cell* cell;
+      if(segments[k].size() == 1) {
+        int i = segments[k].front();
+        cell = module->addMux(NEW_ID, a, chain.cases[i], chain.selects[i], outputs[k]);
+      }
+      else {
+        RTLIL::SigSpec b, sel;
+        for(int i: segments[k]) {
+          b.append(chain.cases[i]);
+          sel.append(chain.selects[i]);
+        }
+        cell = module->addPmux(NEW_ID, a, b, sel, outputs[k]);
+        pmuxes++;
+      }
+      idx.add_cell(cell);
+    }
+    stats.chains++;
+    stats.muxes += n;
+    stats.pmuxes += pmuxes;
+    stats.droppedCases += n - live.size();
+    stats.depthBefore += n;
+    stats.depthAfter += segments.size();
+  }
+  return stats;
+}
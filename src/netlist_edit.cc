@@ -0,0 +1,312 @@
+#include "ctrd_prop.h"
+#include "util.h"
+#include "netlist_edit.h"
+
+USING_YOSYS_NAMESPACE
+
+EditLog g_edit_log;
+
+
+void EditLog::tie_const(RTLIL::Cell* cell, RTLIL::SigSpec sig, RTLIL::Const value) {
+  // comparator outputs wider than one bit are zero-extended
+  value.bits.resize(sig.size(), RTLIL::State::S0);
+  edits.push_back(Edit{cell->module, cell, sig, value, Builder_t(), RTLIL::IdString()});
+}
+
+
+void EditLog::replace(RTLIL::Cell* cell, RTLIL::SigSpec sig, Builder_t build) {
+  edits.push_back(Edit{cell->module, cell, sig, RTLIL::Const(), build, RTLIL::IdString()});
+}
+
+
+void EditLog::tie_port(RTLIL::Cell* cell, RTLIL::IdString port, RTLIL::SigSpec sig,
+                       RTLIL::Const value) {
+  edits.push_back(Edit{cell->module, cell, sig, value, Builder_t(), port});
+}
+
+
+bool EditLog::has_edit(RTLIL::Cell* cell) const {
+  for(auto &edit: edits)
+    if(edit.cell == cell && edit.port.empty()) return true;
+  return false;
+}
+
+
+void EditStats::log_summary() const {
+  log("Tied %d cells to constants, replaced %d cells, folded %d cells, swept %d dead cells.\n",
+      tied, replaced, folded, swept);
+  if(carried > 0)
+    log("Carried %d constant instance outputs into their parents.\n", carried);
+  for(auto &pair: removedTypes)
+    log("  removed %5d %s\n", pair.second, log_id(pair.first));
+}
+
+
+PRIVATE_NAMESPACE_BEGIN
+
+bool removable_cell(RTLIL::Cell* cell) {
+  if(!cell->type.begins_with("$")) return false;
+  if(cell->has_keep_attr()) return false;
+  return !cell->type.in(ID($assert), ID($assume), ID($cover), ID($live));
+}
+
+
+void remove_cell(ModIndex &idx, RTLIL::Cell* cell, EditStats &stats) {
+  stats.removedTypes[cell->type]++;
+  idx.remove_cell(cell);
+  idx.module->remove(cell);
+}
+
+
+void add_input_drivers(const ModIndex &idx, RTLIL::Cell* cell, std::set<RTLIL::Cell*> &seeds) {
+  for(auto &conn: cell->connections_)
+    if(cell->input(conn.first))
+      for(auto driver: idx.drivers(conn.second))
+        if(driver != cell) seeds.insert(driver);
+}
+
+
+// look up the value of sig in the constants found so far
+bool get_const(RTLIL::SigSpec sig, const dict<RTLIL::SigBit, RTLIL::State> &constBits,
+               RTLIL::Const &value) {
+  std::vector<RTLIL::State> bits;
+  for(auto bit: sig) {
+    if(bit.wire == nullptr) {
+      if(bit.data != RTLIL::State::S0 && bit.data != RTLIL::State::S1) return false;
+      bits.push_back(bit.data);
+      continue;
+    }
+    auto it = constBits.find(bit);
+    if(it == constBits.end()) return false;
+    bits.push_back(it->second);
+  }
+  value = RTLIL::Const(bits);
+  return true;
+}
+
+
+bool foldable_type(RTLIL::IdString type) {
+  static const pool<RTLIL::IdString> types = {
+    ID($not), ID($pos), ID($neg), ID($and), ID($or), ID($xor), ID($xnor),
+    ID($reduce_and), ID($reduce_or), ID($reduce_xor), ID($reduce_xnor), ID($reduce_bool),
+    ID($logic_not), ID($logic_and), ID($logic_or),
+    ID($eq), ID($ne), ID($lt), ID($le), ID($gt), ID($ge),
+    ID($add), ID($sub), ID($shl), ID($shr)
+  };
+  return types.count(type) > 0;
+}
+
+
+// Work out what a reader of a newly constant signal reduces to. Returns
+// false if the cell stays as it is; otherwise `result` is the signal
+// that replaces its Y output.
+bool fold_cell(RTLIL::Cell* cell, const dict<RTLIL::SigBit, RTLIL::State> &constBits,
+               RTLIL::SigSpec &result) {
+  RTLIL::Const a, b, sel;
+  if(cell->type == ID($mux)) {
+    if(!get_const(cell->getPort(ID::S), constBits, sel)) return false;
+    result = sel.as_bool() ? cell->getPort(ID::B) : cell->getPort(ID::A);
+    return true;
+  }
+  if(cell->type == ID($pmux)) {
+    if(!get_const(cell->getPort(ID::S), constBits, sel)) return false;
+    int width = cell->getParam(ID::WIDTH).as_int();
+    int hot = -1;
+    for(int i = 0; i < sel.size(); i++) {
+      if(sel.bits[i] != RTLIL::State::S1) continue;
+      // several active cases leave the output undefined
+      if(hot >= 0) return false;
+      hot = i;
+    }
+    if(hot < 0) result = cell->getPort(ID::A);
+    else result = cell->getPort(ID::B).extract(hot * width, width);
+    return true;
+  }
+  if(!foldable_type(cell->type)) return false;
+  RTLIL::SigSpec y = cell->getPort(ID::Y);
+  bool constA = get_const(cell->getPort(ID::A), constBits, a);
+  bool constB = cell->hasPort(ID::B) && get_const(cell->getPort(ID::B), constBits, b);
+  // a controlling input decides single-bit logic on its own
+  if(y.size() == 1 && (constA || constB)) {
+    RTLIL::Const known = constA ? a : b;
+    // logic ops reduce the whole operand, bitwise ones only see bit 0
+    RTLIL::State bit;
+    if(cell->type.in(ID($logic_and), ID($logic_or)))
+      bit = known.as_bool() ? RTLIL::State::S1 : RTLIL::State::S0;
+    else bit = known.size() > 0 ? known.bits[0] : RTLIL::State::Sx;
+    bool isAnd = cell->type.in(ID($and), ID($logic_and));
+    bool isOr = cell->type.in(ID($or), ID($logic_or));
+    if(isAnd && bit == RTLIL::State::S0) {
+      result = RTLIL::SigSpec(RTLIL::State::S0);
+      return true;
+    }
+    if(isOr && bit == RTLIL::State::S1) {
+      result = RTLIL::SigSpec(RTLIL::State::S1);
+      return true;
+    }
+  }
+  if(!constA || (cell->hasPort(ID::B) && !constB)) return false;
+  bool err = false;
+  RTLIL::Const value = CellTypes::eval(cell, a, b, &err);
+  if(err) return false;
+  result = RTLIL::SigSpec(value);
+  return true;
+}
+
+PRIVATE_NAMESPACE_END
+
+
+/// propagate constants forward through the readers of the tied signals
+int fold_constants(ModIndex &idx, dict<RTLIL::SigBit, RTLIL::State> &constBits,
+                   std::set<RTLIL::Cell*> work, std::set<RTLIL::Cell*> &seeds, EditStats &stats) {
+  RTLIL::Module* module = idx.module;
+  int folded = 0;
+  pool<RTLIL::Cell*> removed;
+  while(!work.empty()) {
+    RTLIL::Cell* cell = *work.begin();
+    work.erase(work.begin());
+    if(removed.count(cell) || !removable_cell(cell) || !cell->hasPort(ID::Y)) continue;
+    RTLIL::SigSpec result;
+    if(!fold_cell(cell, constBits, result)) continue;
+    RTLIL::SigSpec y = cell->getPort(ID::Y);
+    result.extend_u0(y.size());
+    add_input_drivers(idx, cell, seeds);
+    removed.insert(cell);
+    remove_cell(idx, cell, stats);
+    module->connect(y, result);
+    idx.add_live(result);
+    folded++;
+    // only readers of bits that became constant can fold further
+    for(int i = 0; i < y.size(); i++) {
+      RTLIL::SigBit bit = result[i];
+      RTLIL::State state;
+      if(bit.wire == nullptr) state = bit.data;
+      else if(constBits.count(bit)) state = constBits.at(bit);
+      else continue;
+      if(state != RTLIL::State::S0 && state != RTLIL::State::S1) continue;
+      constBits[y[i]] = state;
+      for(auto reader: idx.cells(y[i]))
+        if(!removed.count(reader)) work.insert(reader);
+    }
+  }
+  for(auto cell: removed) seeds.erase(cell);
+  return folded;
+}
+
+
+/// Apply all recorded edits, one batch per module. Output ports that end
+/// up driven by constants are cut off at every instance of the module
+/// and the constants folded on in the parent, which gets a batch of its
+/// own.
+EditStats EditLog::commit() {
+  // edits are referred to by index, since carried constants append more
+  std::vector<RTLIL::Module*> modules;
+  dict<RTLIL::Module*, std::vector<size_t>> byModule;
+  for(size_t i = 0; i < edits.size(); i++) {
+    if(byModule.count(edits[i].module) == 0) modules.push_back(edits[i].module);
+    byModule[edits[i].module].push_back(i);
+  }
+
+  EditStats stats;
+  for(size_t m = 0; m < modules.size(); m++) {
+    RTLIL::Module* module = modules[m];
+    std::vector<size_t> batch;
+    batch.swap(byModule[module]);
+    ModIndex &idx = get_mod_index(module);
+    pool<RTLIL::Cell*> done;
+    std::set<RTLIL::Cell*> seeds;
+    std::set<RTLIL::Cell*> readers;
+    dict<RTLIL::SigBit, RTLIL::State> constBits;
+    for(auto i: batch) {
+      const Edit* edit = &edits[i];
+      RTLIL::Cell* cell = edit->cell;
+      if(!edit->port.empty()) {
+        if(done.count(cell) || !cell->hasPort(edit->port)) continue;
+        idx.remove_cell(cell);
+        cell->unsetPort(edit->port);
+        idx.add_cell(cell);
+      }
+      else {
+        // the same cell may be proven from several instance paths
+        if(done.count(cell)) continue;
+        done.insert(cell);
+        add_input_drivers(idx, cell, seeds);
+        remove_cell(idx, cell, stats);
+      }
+      if(edit->build) {
+        RTLIL::SigSpec driver = edit->build(idx);
+        module->connect(edit->sig, driver);
+        idx.add_live(edit->sig);
+        idx.add_live(driver);
+        stats.replaced++;
+        continue;
+      }
+      module->connect(edit->sig, RTLIL::SigSpec(edit->value));
+      idx.add_live(edit->sig);
+      for(int i = 0; i < edit->sig.size(); i++)
+        constBits[edit->sig[i]] = edit->value.bits[i];
+      for(auto reader: idx.cells(edit->sig))
+        readers.insert(reader);
+      stats.tied++;
+    }
+    for(auto cell: done) {
+      seeds.erase(cell);
+      readers.erase(cell);
+    }
+    stats.folded += fold_constants(idx, constBits, readers, seeds, stats);
+    stats.swept += sweep_dead_cone(idx, seeds, stats);
+
+    // the module's outputs that are now constant, on every instance
+    std::vector<std::pair<RTLIL::IdString, RTLIL::Const>> outputs;
+    for(auto &name: module->ports) {
+      RTLIL::Wire* wire = module->wire(name);
+      RTLIL::Const value;
+      if(wire != nullptr && wire->port_output && !wire->port_input &&
+         get_const(RTLIL::SigSpec(wire), constBits, value))
+        outputs.push_back(std::make_pair(name, value));
+    }
+    if(outputs.empty() || module->design == nullptr) continue;
+    for(auto parent: module->design->modules())
+      for(auto cell: parent->cells()) {
+        if(cell->type != module->name) continue;
+        for(auto &output: outputs) {
+          if(!cell->hasPort(output.first)) continue;
+          RTLIL::SigSpec sig = cell->getPort(output.first);
+          if(sig.size() != output.second.size()) continue;
+          // a module still waiting for its batch has edits already
+          if(byModule[parent].empty()) modules.push_back(parent);
+          byModule[parent].push_back(edits.size());
+          edits.push_back(Edit{parent, cell, sig, output.second, Builder_t(), output.first});
+          stats.carried++;
+        }
+      }
+  }
+  edits.clear();
+  return stats;
+}
+
+
+/// remove cells whose outputs lost all their readers, starting from
+/// the seeds and walking backwards through their input cones
+int sweep_dead_cone(ModIndex &idx, const std::set<RTLIL::Cell*> &seeds, EditStats &stats) {
+  std::vector<RTLIL::Cell*> work(seeds.begin(), seeds.end());
+  pool<RTLIL::Cell*> removed;
+  while(!work.empty()) {
+    RTLIL::Cell* cell = work.back();
+    work.pop_back();
+    if(removed.count(cell) || !removable_cell(cell)) continue;
+    bool dead = true;
+    for(auto &conn: cell->connections_) {
+      if(!cell->output(conn.first)) continue;
+      for(auto bit: conn.second)
+        if(idx.is_read(bit)) dead = false;
+    }
+    if(!dead) continue;
+    std::set<RTLIL::Cell*> drivers;
+    add_input_drivers(idx, cell, drivers);
+    work.insert(work.end(), drivers.begin(), drivers.end());
+    removed.insert(cell);
+    remove_cell(idx, cell, stats);
+  }
+  return removed.size();
+}
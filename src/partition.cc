@@ -0,0 +1,511 @@
+#include "ctrd_prop.h"
+#include "util.h"
+#include "snapshot.h"
+#include "scheduler.h"
+#include "bit_solver.h"
+#include "bdd.h"
+#include "query_cache.h"
+#include "partition.h"
+#include "shard.h"
+
+USING_YOSYS_NAMESPACE
+
+
+void ClusterStats::log_summary(int threads) const {
+  if(clusters == 0) return;
+  std::vector<int> sorted = sizes;
+  std::sort(sorted.begin(), sorted.end());
+  long total = 0;
+  for(auto size: sorted) total += size;
+  log("Partitioned %d cones into %d clusters of %d/%d/%d cells (min/median/max), %ld in all.\n",
+      cones, clusters, sorted.front(), sorted[sorted.size() / 2], sorted.back(), total);
+  log("Cluster solvers (%s) on %d threads proved %d of %d candidates; %d are left to the final check.\n",
+      solver_name(solver), threads, proven, candidates, satisfiable);
+  bdd.log_summary();
+  cache.log_summary(cacheFile);
+  aig.log_summary();
+}
+
+
+PRIVATE_NAMESPACE_BEGIN
+
+int find_root(std::vector<int> &parent, int x) {
+  while(parent[x] != x) {
+    parent[x] = parent[parent[x]];
+    x = parent[x];
+  }
+  return x;
+}
+
+
+/// Split the fanout cone of `root` into connected components. Cells are
+/// connected if one drives the other; the constrained bits themselves
+/// do not connect anything.
+std::vector<Cluster> partition_cone(const SnapModule &sm, const CandidateGroup &group) {
+  const std::vector<int> &root = group.root;
+  int numCells = sm.num_cells();
+  std::vector<int> driver(sm.numBits, -1);
+  std::vector<std::vector<int>> readers(sm.numBits);
+  for(int i = 0; i < numCells; i++)
+    for(int j = sm.cellConn[i]; j < sm.cellConn[i + 1]; j++)
+      for(auto bit: sm.conn_bits(j)) {
+        if(bit <= BIT_CONSTX) continue;
+        if(sm.connDir[j] & PORT_OUT) driver[bit] = i;
+        else readers[bit].push_back(i);
+      }
+
+  std::vector<bool> inCone(numCells, false);
+  std::vector<int> work(root.begin(), root.end());
+  std::vector<bool> seen(sm.numBits, false);
+  while(!work.empty()) {
+    int bit = work.back();
+    work.pop_back();
+    if(bit <= BIT_CONSTX || seen[bit]) continue;
+    seen[bit] = true;
+    for(auto cell: readers[bit]) {
+      if(inCone[cell]) continue;
+      inCone[cell] = true;
+      for(int j = sm.cellConn[cell]; j < sm.cellConn[cell + 1]; j++)
+        if(sm.connDir[j] & PORT_OUT)
+          for(auto out: sm.conn_bits(j)) work.push_back(out);
+    }
+  }
+
+  std::vector<int> parent(numCells);
+  for(int i = 0; i < numCells; i++) parent[i] = i;
+  for(int i = 0; i < numCells; i++) {
+    if(!inCone[i]) continue;
+    for(int j = sm.cellConn[i]; j < sm.cellConn[i + 1]; j++) {
+      if(sm.connDir[j] & PORT_OUT) continue;
+      for(auto bit: sm.conn_bits(j))
+        if(bit > BIT_CONSTX && driver[bit] >= 0 && inCone[driver[bit]])
+          parent[find_root(parent, i)] = find_root(parent, driver[bit]);
+    }
+  }
+
+  std::map<int, int> clusterOf;
+  std::vector<Cluster> clusters;
+  for(size_t m = 0; m < group.cells.size(); m++) {
+    if(!inCone[group.cells[m]]) continue;
+    int rep = find_root(parent, group.cells[m]);
+    if(clusterOf.count(rep) == 0) {
+      clusterOf[rep] = clusters.size();
+      clusters.push_back(Cluster{&group, std::vector<int>(), std::vector<int>()});
+    }
+    clusters[clusterOf[rep]].members.push_back(m);
+  }
+  for(auto cell: sm.order)
+    if(inCone[cell] && clusterOf.count(find_root(parent, cell)))
+      clusters[clusterOf[find_root(parent, cell)]].cells.push_back(cell);
+  return clusters;
+}
+
+
+bool is_modelled(SnapOp op) {
+  return op != OP_UNKNOWN && op != OP_INSTANCE && op != OP_PMUX;
+}
+
+
+/// Cells of the cluster in the fanin of `work`, and the bits they read
+/// from outside the cone. Unmodelled cells end the cone; their outputs
+/// are inputs of it.
+void fanin_cone(const SnapModule &sm, const std::map<int, int> &driver,
+                std::vector<int> work, std::set<int> &cone, std::set<int> &leaves) {
+  while(!work.empty()) {
+    int cell = work.back();
+    work.pop_back();
+    if(cone.count(cell)) continue;
+    cone.insert(cell);
+    for(int j = sm.cellConn[cell]; j < sm.cellConn[cell + 1]; j++) {
+      if(sm.connDir[j] & PORT_OUT) continue;
+      for(auto bit: sm.conn_bits(j)) {
+        if(bit <= BIT_CONSTX) continue;
+        auto it = driver.find(bit);
+        if(it != driver.end() && is_modelled(sm.cellOp[it->second])) work.push_back(it->second);
+        else leaves.insert(bit);
+      }
+    }
+  }
+}
+
+
+// Bit-level encoding of snapshot cells into one solver. A functional
+// encoder substitutes cell outputs instead of constraining them, which
+// is what BDDs need.
+struct ClusterEncoder {
+  BitSolver &s;
+  std::map<int, int> bits;
+  bool functional;
+
+  int bit(int id) {
+    if(id == BIT_CONST0) return s.lit_const(false);
+    if(id == BIT_CONST1) return s.lit_const(true);
+    if(id == BIT_CONSTX) return s.lit_new();
+    auto it = bits.find(id);
+    if(it != bits.end()) return it->second;
+    int lit = s.lit_new();
+    bits[id] = lit;
+    return lit;
+  }
+  int ext(BitRange sig, size_t i) { return i < sig.size() ? bit(sig[i]) : s.lit_const(false); }
+  int any(BitRange sig) {
+    int r = s.lit_const(false);
+    for(auto b: sig) r = s.lit_or(r, bit(b));
+    return r;
+  }
+  void drive(BitRange y, size_t i, int value) {
+    if(y[i] <= BIT_CONSTX) return;
+    if(functional && !bits.count(y[i])) bits[y[i]] = value;
+    else s.add(s.lit_iff(bit(y[i]), value));
+  }
+  void drive_first(BitRange y, int value) {
+    for(size_t i = 0; i < y.size(); i++)
+      drive(y, i, i == 0 ? value : s.lit_const(false));
+  }
+  void encode(const SnapModule &sm, int cell);
+  int equals(BitRange sig, uint32_t value) {
+    int r = s.lit_const(true);
+    for(size_t i = 0; i < sig.size(); i++)
+      r = s.lit_and(r, ((value >> i) & 1) ? bit(sig[i]) : s.lit_not(bit(sig[i])));
+    return r;
+  }
+  void constrain(BitRange root, const ValueSet_t &values);
+};
+
+
+void ClusterEncoder::constrain(BitRange root, const ValueSet_t &values) {
+  size_t allowed = std::count(values.begin(), values.end(), true);
+  // the shorter of the two descriptions of the value set
+  if(allowed * 2 > values.size()) {
+    for(uint32_t v = 0; v < values.size(); v++)
+      if(!values[v]) s.add(s.lit_not(equals(root, v)));
+  }
+  else {
+    int r = s.lit_const(false);
+    for(uint32_t v = 0; v < values.size(); v++)
+      if(values[v]) r = s.lit_or(r, equals(root, v));
+    s.add(r);
+  }
+}
+
+
+// outputs of cells that are not modelled stay unconstrained
+void ClusterEncoder::encode(const SnapModule &sm, int cell) {
+  SnapOp op = sm.cellOp[cell];
+  if(!is_modelled(op)) return;
+  BitRange a = sm.cell_bits(cell, NAME_A);
+  BitRange b = sm.cell_bits(cell, NAME_B);
+  BitRange y = sm.cell_bits(cell, NAME_Y);
+  switch(op) {
+  case OP_NOT:
+    for(size_t i = 0; i < y.size(); i++) drive(y, i, s.lit_not(ext(a, i)));
+    break;
+  case OP_AND: case OP_OR: case OP_XOR: case OP_XNOR:
+    for(size_t i = 0; i < y.size(); i++) {
+      int ea = ext(a, i), eb = ext(b, i);
+      drive(y, i, op == OP_AND ? s.lit_and(ea, eb) : op == OP_OR ? s.lit_or(ea, eb) :
+                  op == OP_XOR ? s.lit_xor(ea, eb) : s.lit_iff(ea, eb));
+    }
+    break;
+  case OP_REDUCE_AND: {
+    int r = s.lit_const(true);
+    for(auto bitId: a) r = s.lit_and(r, bit(bitId));
+    drive_first(y, r);
+    break;
+  }
+  case OP_REDUCE_OR: case OP_REDUCE_BOOL:
+    drive_first(y, any(a));
+    break;
+  case OP_REDUCE_XOR: {
+    int r = s.lit_const(false);
+    for(auto bitId: a) r = s.lit_xor(r, bit(bitId));
+    drive_first(y, r);
+    break;
+  }
+  case OP_LOGIC_NOT:
+    drive_first(y, s.lit_not(any(a)));
+    break;
+  case OP_LOGIC_AND:
+    drive_first(y, s.lit_and(any(a), any(b)));
+    break;
+  case OP_LOGIC_OR:
+    drive_first(y, s.lit_or(any(a), any(b)));
+    break;
+  case OP_EQ: case OP_NE: {
+    int r = s.lit_const(true);
+    for(size_t i = 0; i < std::max(a.size(), b.size()); i++)
+      r = s.lit_and(r, s.lit_iff(ext(a, i), ext(b, i)));
+    drive_first(y, op == OP_EQ ? r : s.lit_not(r));
+    break;
+  }
+  case OP_MUX: {
+    int sel = bit(sm.cell_bits(cell, NAME_S)[0]);
+    for(size_t i = 0; i < y.size(); i++) drive(y, i, s.lit_ite(sel, ext(b, i), ext(a, i)));
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+
+/// the cluster cell driving each bit
+std::map<int, int> cluster_drivers(const SnapModule &sm, const Cluster &cluster) {
+  std::map<int, int> driver;
+  for(auto cell: cluster.cells)
+    for(int j = sm.cellConn[cell]; j < sm.cellConn[cell + 1]; j++)
+      if(sm.connDir[j] & PORT_OUT)
+        for(auto bit: sm.conn_bits(j)) driver[bit] = cell;
+  return driver;
+}
+
+
+/// Structural hash of the query for one candidate: the constraint on
+/// the root, the polarity, and the modelled cone with bits renamed in
+/// visiting order. Equal keys mean equal queries up to naming.
+QueryKey cone_key(const NetSnapshot &snap, const CandidateGroup &group,
+                  const std::map<int, int> &driver, int m) {
+  const SnapModule &sm = snap.modules[group.module];
+  QueryHasher h;
+  h.add("opt_ctrd cluster query 1");
+  std::map<int, uint64_t> ids;
+  auto id_of = [&ids](int bit) -> uint64_t {
+    if(bit <= BIT_CONSTX) return bit;
+    auto it = ids.find(bit);
+    if(it != ids.end()) return it->second;
+    uint64_t id = BIT_CONSTX + 1 + ids.size();
+    ids[bit] = id;
+    return id;
+  };
+  h.add(group.root.size());
+  for(auto bit: group.root) h.add(id_of(bit));
+  const ValueSet_t &values = *group.values;
+  h.add(values.size());
+  for(size_t v = 0; v < values.size(); v += 64) {
+    uint64_t word = 0;
+    for(size_t i = v; i < std::min(values.size(), v + 64); i++)
+      if(values[i]) word |= 1ull << (i - v);
+    h.add(word);
+  }
+  h.add(group.isNe[m]);
+
+  std::set<int> seen;
+  std::vector<int> work{group.cells[m]};
+  while(!work.empty()) {
+    int cell = work.back();
+    work.pop_back();
+    if(seen.count(cell)) continue;
+    seen.insert(cell);
+    h.add(sm.cellOp[cell]);
+    for(int j = sm.cellConn[cell]; j < sm.cellConn[cell + 1]; j++) {
+      h.add(snap.names[sm.connName[j]]);
+      h.add(sm.connDir[j]);
+      BitRange bits = sm.conn_bits(j);
+      h.add(bits.size());
+      for(auto bit: bits) {
+        h.add(id_of(bit));
+        if(sm.connDir[j] & PORT_OUT) continue;
+        auto it = driver.find(bit);
+        if(it != driver.end() && is_modelled(sm.cellOp[it->second])) work.push_back(it->second);
+      }
+    }
+  }
+  return h.key();
+}
+
+
+/// Answer the candidates of one cluster with solvers of its own.
+/// Candidates whose cone reads few bits are decided on BDDs that share
+/// their subcones; the rest go to `s`. Only the fanin of the candidates
+/// inside the cluster is encoded. A proven candidate gets its output
+/// value as answer, one the cluster solver could not prove gets
+/// VERDICT_CLUSTER_SAT, and one whose check hit a limit stays
+/// VERDICT_UNKNOWN.
+void solve_cluster(const NetSnapshot &snap, const Cluster &cluster, BitSolver &s,
+                   BddStats &bddStats, std::vector<int> &answers) {
+  const CandidateGroup &group = *cluster.group;
+  const SnapModule &sm = snap.modules[group.module];
+  std::map<int, int> driver = cluster_drivers(sm, cluster);
+  BitRange root{group.root.data(), group.root.data() + group.root.size()};
+
+  std::vector<int> small, rest;
+  std::set<int> smallCone, restCone;
+  for(auto m: cluster.members) {
+    std::set<int> cone, leaves;
+    fanin_cone(sm, driver, {group.cells[m]}, cone, leaves);
+    bool isSmall = (int)leaves.size() <= BDD_MAX_SUPPORT;
+    (isSmall ? small : rest).push_back(m);
+    (isSmall ? smallCone : restCone).insert(cone.begin(), cone.end());
+  }
+
+  if(!small.empty()) {
+    BddBitSolver bs(bddStats);
+    ClusterEncoder enc{bs, std::map<int, int>(), true};
+    enc.constrain(root, *group.values);
+    for(auto cell: cluster.cells)
+      if(smallCone.count(cell)) enc.encode(sm, cell);
+    for(auto m: small) {
+      bddStats.candidates++;
+      if(bs.bdd.overflow) {
+        bddStats.overflows++;
+        rest.push_back(m);
+        std::set<int> leaves;
+        fanin_cone(sm, driver, {group.cells[m]}, restCone, leaves);
+        continue;
+      }
+      bool isNe = group.isNe[m];
+      int out = enc.bit(sm.cell_bits(group.cells[m], NAME_Y)[0]);
+      if(!bs.satisfiable(isNe ? bs.lit_not(out) : out)) {
+        answers[group.candidates[m]] = isNe ? 1 : 0;
+        bddStats.decided++;
+      }
+      else answers[group.candidates[m]] = VERDICT_CLUSTER_SAT;
+      // the subcone BDDs stay cached for the next candidates
+      std::vector<int> live;
+      for(auto &pair: enc.bits) live.push_back(pair.second);
+      bs.collect(live);
+    }
+  }
+  if(rest.empty()) return;
+
+  ClusterEncoder enc{s, std::map<int, int>(), false};
+  enc.constrain(root, *group.values);
+  for(auto cell: cluster.cells)
+    if(restCone.count(cell)) enc.encode(sm, cell);
+  for(auto m: rest) {
+    bool isNe = group.isNe[m];
+    int out = enc.bit(sm.cell_bits(group.cells[m], NAME_Y)[0]);
+    int unknowns = s.unknowns;
+    if(!s.satisfiable(isNe ? s.lit_not(out) : out)) answers[group.candidates[m]] = isNe ? 1 : 0;
+    else if(s.unknowns == unknowns) answers[group.candidates[m]] = VERDICT_CLUSTER_SAT;
+  }
+}
+
+PRIVATE_NAMESPACE_END
+
+
+/// Split the fanout cone of each candidate group into connected
+/// components and solve the components in parallel, each with its own
+/// context. Proven candidates get their verdict; the rest are left to
+/// simplify(). With a query cache, candidates whose query was answered
+/// in an earlier run are not solved again, and only answers the solver
+/// reached without a limit are stored. VERDICT_CLUSTER_SAT in the cache
+/// means the cluster query is satisfiable; it sends the candidate to
+/// the final check without another cluster query. Timed ezSAT solves run in
+/// worker processes rather than threads, as their timer is per process;
+/// the AIG and BDD counts of those workers are not reported.
+ClusterStats solve_clusters(const NetSnapshot &snap, int threads, SolverKind kind) {
+  ClusterStats stats;
+  std::vector<CandidateGroup> groups = group_candidates(snap);
+  std::vector<Cluster> clusters;
+  for(auto &group: groups) {
+    std::vector<Cluster> cone = partition_cone(snap.modules[group.module], group);
+    stats.cones++;
+    clusters.insert(clusters.end(), cone.begin(), cone.end());
+  }
+  if(clusters.empty()) return stats;
+
+  TaskScheduler sched(threads);
+  std::vector<AigStats> aigStats(sched.threads());
+  std::vector<BddStats> bddStats(sched.threads());
+  std::vector<int> answers(g_check_vec.size(), VERDICT_UNKNOWN);
+
+  QueryCache cache;
+  std::vector<QueryKey> keys(g_check_vec.size());
+  std::vector<bool> hit(g_check_vec.size(), false);
+  std::vector<Cluster> unsolved = clusters;
+  if(!g_options.cacheFile.empty() && cache.open(g_options.cacheFile, g_options.cacheEntries)) {
+    cache.lock(false);
+    for(auto &cluster: unsolved) {
+      const CandidateGroup &group = *cluster.group;
+      std::map<int, int> driver = cluster_drivers(snap.modules[group.module], cluster);
+      std::vector<int> members;
+      for(auto m: cluster.members) {
+        int k = group.candidates[m];
+        keys[k] = cone_key(snap, group, driver, m);
+        hit[k] = cache.lookup(keys[k], answers[k]);
+        if(!hit[k]) members.push_back(m);
+      }
+      cluster.members = members;
+    }
+    cache.unlock();
+  }
+
+  // clusters whose task ran to the end rather than stopping for the
+  // budget; one flag per task, so no two threads share an element
+  std::vector<char> solved(unsolved.size(), 0);
+  // ezSAT times a solve with a process-wide alarm, so timed ezSAT
+  // clusters are dealt out to worker processes, each with its own timer
+  bool forked = kind != SOLVER_Z3 && sched.threads() > 1 && query_timeout() > 0;
+  if(forked) {
+    int procs = sched.threads();
+    std::vector<int> shardOf(g_check_vec.size(), -1);
+    for(size_t i = 0; i < unsolved.size(); i++)
+      for(auto m: unsolved[i].members) shardOf[unsolved[i].group->candidates[m]] = i % procs;
+    ShardStats shardStats;
+    std::vector<int> values = run_sharded(procs, shardOf, [&](int shard) {
+      std::vector<int> part(g_check_vec.size(), VERDICT_UNKNOWN);
+      for(size_t i = shard; i < unsolved.size(); i += procs) {
+        if(unsolved[i].members.empty() || g_budget.exhausted()) continue;
+        std::unique_ptr<BitSolver> s = make_bit_solver(kind, aigStats[0]);
+        solve_cluster(snap, unsolved[i], *s, bddStats[0], part);
+      }
+      return part;
+    }, shardStats);
+    for(size_t k = 0; k < values.size(); k++)
+      if(shardOf[k] >= 0) answers[k] = values[k];
+    // a worker that failed leaves its candidates unknown, which the cache skips
+    std::fill(solved.begin(), solved.end(), 1);
+    log("Solved the clusters in %d worker processes, each timing its own solves.\n", procs);
+    if(shardStats.failed > 0)
+      log_warning("%d worker processes failed; their candidates are left to the final check.\n",
+                  shardStats.failed);
+  }
+  for(size_t i = 0; i < unsolved.size() && !forked; i++) {
+    if(unsolved[i].members.empty()) continue;
+    const Cluster* ptr = &unsolved[i];
+    char* done = &solved[i];
+    sched.spawn(-1, [&snap, ptr, done, &aigStats, &bddStats, &answers, kind](int worker) {
+      if(g_budget.exhausted()) return;
+      std::unique_ptr<BitSolver> s = make_bit_solver(kind, aigStats[worker]);
+      solve_cluster(snap, *ptr, *s, bddStats[worker], answers);
+      *done = 1;
+    });
+  }
+  sched.run();
+
+  if(cache.is_open()) {
+    // hits are stored again to mark them recently used
+    cache.lock(true);
+    for(size_t i = 0; i < clusters.size(); i++)
+      for(auto m: clusters[i].members) {
+        int k = clusters[i].group->candidates[m];
+        if(hit[k] || (solved[i] && answers[k] != VERDICT_UNKNOWN)) cache.insert(keys[k], answers[k]);
+      }
+    cache.unlock();
+    stats.cache = cache.stats;
+    stats.cacheFile = cache.path;
+  }
+
+  for(auto &cluster: clusters) {
+    stats.clusters++;
+    stats.sizes.push_back(cluster.cells.size());
+    for(auto m: cluster.members) {
+      int k = cluster.group->candidates[m];
+      stats.candidates++;
+      // older cache files stored these as VERDICT_VARIES
+      if(answers[k] == VERDICT_CLUSTER_SAT || answers[k] == VERDICT_VARIES) {
+        g_check_vec[k].verdict = VERDICT_CLUSTER_SAT;
+        stats.satisfiable++;
+      }
+      if(answers[k] < 0) continue;
+      g_check_vec[k].verdict = answers[k];
+      stats.proven++;
+    }
+  }
+  stats.solver = kind;
+  for(auto &aig: aigStats) stats.aig.add(aig);
+  for(auto &bdd: bddStats) stats.bdd.add(bdd);
+  stats.log_summary(sched.threads());
+  return stats;
+}
@@ -0,0 +1,153 @@
+#include "ctrd_prop.h"
+#include "util.h"
+#include "snapshot.h"
+#include "payoff.h"
+
+#include <memory>
+
+USING_YOSYS_NAMESPACE
+
+
+PRIVATE_NAMESPACE_BEGIN
+
+// Reference counts of one snapshot module, for maximum fanout-free
+// cone sizes.
+struct ConeCounter {
+  const SnapModule &sm;
+  std::vector<int> driver;
+  std::vector<int> refs;      // readers per bit, module outputs included
+  std::vector<int> liveOuts;  // output bits per cell still read
+  std::vector<int> depth;     // longest path from a cell to a sink
+  std::map<int, std::vector<int>> muxesBySelect;
+
+  explicit ConeCounter(const SnapModule &sm);
+  int deref(const std::vector<int> &bits);
+  std::vector<int> inputs(int cell) const;
+};
+
+
+ConeCounter::ConeCounter(const SnapModule &sm) : sm(sm), driver(sm.numBits, -1),
+    refs(sm.numBits, 0), liveOuts(sm.num_cells(), 0), depth(sm.num_cells(), 1) {
+  for(int i = 0; i < sm.num_cells(); i++)
+    for(int j = sm.cellConn[i]; j < sm.cellConn[i + 1]; j++)
+      for(auto bit: sm.conn_bits(j)) {
+        if(bit <= BIT_CONSTX) continue;
+        if(sm.connDir[j] & PORT_OUT) driver[bit] = i;
+        else refs[bit]++;
+      }
+  for(size_t p = 0; p < sm.portWire.size(); p++)
+    if(sm.portDir[p] & PORT_OUT)
+      for(auto bit: sm.wire_bits(sm.portWire[p]))
+        if(bit > BIT_CONSTX) refs[bit]++;
+  for(int bit = 0; bit < sm.numBits; bit++)
+    if(driver[bit] >= 0 && refs[bit] > 0) liveOuts[driver[bit]]++;
+  for(int i = 0; i < sm.num_cells(); i++) {
+    if(sm.cellOp[i] != OP_MUX) continue;
+    BitRange sel = sm.cell_bits(i, NAME_S);
+    if(sel.size() == 1 && sel[0] > BIT_CONSTX) muxesBySelect[sel[0]].push_back(i);
+  }
+  // readers come after their drivers in sm.order
+  for(auto it = sm.order.rbegin(); it != sm.order.rend(); ++it) {
+    int cell = *it;
+    for(auto bit: inputs(cell))
+      if(driver[bit] >= 0 && driver[bit] != cell)
+        depth[driver[bit]] = std::max(depth[driver[bit]], depth[cell] + 1);
+  }
+}
+
+
+std::vector<int> ConeCounter::inputs(int cell) const {
+  std::vector<int> bits;
+  for(int j = sm.cellConn[cell]; j < sm.cellConn[cell + 1]; j++)
+    if(!(sm.connDir[j] & PORT_OUT))
+      for(auto bit: sm.conn_bits(j))
+        if(bit > BIT_CONSTX) bits.push_back(bit);
+  return bits;
+}
+
+
+/// Cells that die once `bits` lose one reader each. The counts are
+/// restored before returning.
+int ConeCounter::deref(const std::vector<int> &bits) {
+  std::vector<int> touchedBits, touchedCells;
+  std::vector<int> work(bits.begin(), bits.end());
+  int dead = 0;
+  while(!work.empty()) {
+    int bit = work.back();
+    work.pop_back();
+    touchedBits.push_back(bit);
+    if(--refs[bit] > 0 || driver[bit] < 0) continue;
+    int cell = driver[bit];
+    touchedCells.push_back(cell);
+    if(--liveOuts[cell] > 0) continue;
+    dead++;
+    for(auto in: inputs(cell)) work.push_back(in);
+  }
+  for(auto bit: touchedBits) refs[bit]++;
+  for(auto cell: touchedCells) liveOuts[cell]++;
+  return dead;
+}
+
+PRIVATE_NAMESPACE_END
+
+
+/// Payoff of every entry of g_check_vec; candidates missing from the
+/// snapshot get none.
+std::vector<Payoff> estimate_payoffs(const NetSnapshot &snap) {
+  std::vector<Payoff> payoffs(g_check_vec.size());
+  std::map<int, std::unique_ptr<ConeCounter>> counters;
+  // all instance paths of a cell share its estimate
+  std::map<std::pair<int, int>, Payoff> known;
+  for(size_t k = 0; k < g_check_vec.size(); k++) {
+    const CheckSet &set = g_check_vec[k];
+    int module = snap.module_id(set.cell->module);
+    if(module < 0) continue;
+    const SnapModule &sm = snap.modules[module];
+    if(counters.count(module) == 0) counters[module].reset(new ConeCounter(sm));
+    int cell = sm.find_cell(set.cell->name.str());
+    if(cell < 0) continue;
+    auto knownIt = known.find(std::make_pair(module, cell));
+    if(knownIt != known.end()) {
+      payoffs[k] = knownIt->second;
+      continue;
+    }
+
+    ConeCounter &cc = *counters[module];
+    Payoff payoff;
+    payoff.cells = 1 + cc.deref(cc.inputs(cell));
+    payoff.depth = cc.depth[cell];
+    // a constant select leaves one data input of each mux unread
+    std::vector<int> muxes;
+    for(auto bit: sm.cell_bits(cell, NAME_Y)) {
+      auto it = cc.muxesBySelect.find(bit);
+      if(it != cc.muxesBySelect.end()) muxes.insert(muxes.end(), it->second.begin(), it->second.end());
+    }
+    for(auto mux: muxes) {
+      std::vector<int> a, b;
+      for(auto bit: sm.cell_bits(mux, NAME_A)) if(bit > BIT_CONSTX) a.push_back(bit);
+      for(auto bit: sm.cell_bits(mux, NAME_B)) if(bit > BIT_CONSTX) b.push_back(bit);
+      payoff.cells += 1 + std::min(cc.deref(a), cc.deref(b));
+    }
+    known[std::make_pair(module, cell)] = payoff;
+    payoffs[k] = payoff;
+  }
+  return payoffs;
+}
+
+
+/// Indexes into g_check_vec, best payoff first. Paths of one cell stay
+/// together, since a cell is only rewritten once all its paths are
+/// proven.
+std::vector<int> payoff_order(const std::vector<Payoff> &payoffs) {
+  std::vector<int> order(payoffs.size());
+  for(size_t k = 0; k < order.size(); k++) order[k] = k;
+  std::stable_sort(order.begin(), order.end(), [&payoffs](int x, int y) {
+    int sx = payoffs[x].score(), sy = payoffs[y].score();
+    if(sx != sy) return sx > sy;
+    RTLIL::Cell* cx = g_check_vec[x].cell;
+    RTLIL::Cell* cy = g_check_vec[y].cell;
+    if(cx->module != cy->module) return cx->module->name < cy->module->name;
+    return cx->name < cy->name;
+  });
+  return order;
+}
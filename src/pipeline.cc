@@ -0,0 +1,137 @@
+#include "ctrd_prop.h"
+#include "util.h"
+#include "value_enum.h"
+#include "facts.h"
+#include "pipeline.h"
+
+using namespace z3;
+
+USING_YOSYS_NAMESPACE
+
+SolvePipeline* g_pipeline = nullptr;
+
+
+void PipelineStats::log_summary(int threads) const {
+  if(candidates == 0) return;
+  log("Pipelined %d candidates in %d batches on %d threads: %d proven, %.1f candidates/s.\n",
+      candidates, batches, threads, proven, candidates / std::max(totalMs / 1000, 1e-3));
+  if(firstMs >= 0)
+    log("First pipelined answer after %.1f ms; propagation waited on a full queue %d times.\n",
+        firstMs, blocked);
+}
+
+
+SolvePipeline::SolvePipeline(solver &s, context &c) : s(s), c(c), queue(PIPELINE_QUEUE_SIZE), answered(false) { }
+
+
+void SolvePipeline::begin(int threads) {
+  if(threads <= 0) threads = std::max(1u, std::thread::hardware_concurrency());
+  start = std::chrono::steady_clock::now();
+  for(int w = 0; w < threads; w++)
+    workers.emplace_back([this]() { work(); });
+}
+
+
+/// queue a candidate found by propagation; unmodelled ones are skipped
+void SolvePipeline::submit(int candidate) {
+  const CheckSet &set = g_check_vec[candidate];
+  expr outExpr = as_bool(c, get_expr(c, set.outSig, set.path));
+  expr ctrdExpr = get_expr(c, set.ctrdSig, set.path);
+  expr cmpExpr = c.bool_val(true);
+  if(!compare_expr(c, set.cell, set.ctrdSig, ctrdExpr, set.forbidValue, cmpExpr)) return;
+  PipeQuery query{candidate, std::vector<int>(), std::vector<std::string>()};
+  // same tries as simplify()
+  if(set.cell->type == ID($eq)) query.values = {0};
+  else if(set.cell->type == ID($ne)) query.values = {1};
+  else query.values = {0, 1};
+  for(auto t: query.values) {
+    solver text(c);
+    text.add(outExpr == cmpExpr);
+    text.add(t ? !outExpr : outExpr);
+    query.queries.push_back(text.to_smt2());
+  }
+  pending.queries.push_back(query);
+  stats.candidates++;
+  if(pending.queries.size() >= PIPELINE_BATCH) flush();
+}
+
+
+void SolvePipeline::flush() {
+  if(pending.queries.empty()) return;
+  sync_facts(s, c);
+  expr_vector assertions = s.assertions();
+  if(assertions.size() > sent) {
+    solver text(c);
+    for(unsigned i = sent; i < assertions.size(); i++) text.add(assertions[i]);
+    std::lock_guard<std::mutex> guard(deltaLock);
+    deltas.push_back(text.to_smt2());
+    sent = assertions.size();
+  }
+  {
+    std::lock_guard<std::mutex> guard(deltaLock);
+    pending.deltas = deltas.size();
+  }
+  stats.batches++;
+  if(queue.push(std::move(pending))) stats.blocked++;
+  pending = PipeBatch();
+}
+
+
+void SolvePipeline::work() {
+  context wc;
+  solver ws(wc);
+  size_t replayed = 0;
+  PipeBatch batch;
+  while(queue.pop(batch)) {
+    if(g_budget.exhausted()) continue;
+    try {
+      while(replayed < batch.deltas) {
+        std::string delta;
+        {
+          std::lock_guard<std::mutex> guard(deltaLock);
+          delta = deltas[replayed];
+        }
+        expr_vector assertions = wc.parse_string(delta.c_str());
+        for(unsigned i = 0; i < assertions.size(); i++) ws.add(assertions[i]);
+        replayed++;
+      }
+      for(auto &query: batch.queries)
+        for(size_t i = 0; i < query.values.size(); i++) {
+          ws.push();
+          expr_vector assertions = wc.parse_string(query.queries[i].c_str());
+          for(unsigned a = 0; a < assertions.size(); a++) ws.add(assertions[a]);
+          limit_query(ws);
+          check_result result = ws.check();
+          ws.pop();
+          if(!answered.exchange(true))
+            stats.firstMs = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count();
+          if(result != unsat) continue;
+          std::lock_guard<std::mutex> guard(resultLock);
+          results.push_back(std::make_pair(query.candidate, query.values[i]));
+          break;
+        }
+    }
+    catch(const z3::exception &) {
+      // a worker that cannot follow the assertions stops answering
+      return;
+    }
+  }
+}
+
+
+/// wait for the workers and hand their proofs to simplify()
+void SolvePipeline::finish() {
+  flush();
+  queue.close();
+  for(auto &worker: workers) worker.join();
+  stats.totalMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  std::sort(results.begin(), results.end());
+  for(auto &result: results) {
+    CheckSet &set = g_check_vec[result.first];
+    if(set.verdict != VERDICT_UNKNOWN) continue;
+    set.verdict = result.second;
+    stats.proven++;
+  }
+  stats.log_summary(workers.size());
+}
@@ -0,0 +1,96 @@
+#include "ctrd_prop.h"
+#include "util.h"
+#include "portfolio.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+
+using namespace z3;
+
+USING_YOSYS_NAMESPACE
+
+const std::vector<std::string> g_solver_configs = {"default", "qf_bv", "qfbv", "bitblast"};
+
+
+void PortfolioStats::log_summary() const {
+  if(races == 0) return;
+  std::string winners;
+  for(auto &pair: wins)
+    winners += stringf("%s%s %d", winners.empty() ? "" : ", ", pair.first.c_str(), pair.second);
+  log("Raced %d hard queries (%d easy ones skipped, %d undecided); wins: %s.\n",
+      races, skipped, undecided, winners.empty() ? "none" : winners.c_str());
+}
+
+
+/// Z3's default solver, the QF_BV logic solver, the qfbv tactic or a
+/// plain bit-blasting pipeline
+solver make_config_solver(context &c, const std::string &config) {
+  if(config == "qf_bv") return solver(c, "QF_BV");
+  if(config == "qfbv") return tactic(c, "qfbv").mk_solver();
+  if(config == "bitblast") return (tactic(c, "simplify") & tactic(c, "bit-blast") & tactic(c, "sat")).mk_solver();
+  return solver(c);
+}
+
+
+/// Solve the current assertions of `s` with every configuration at
+/// once, each in a context of its own. The first sat or unsat answer
+/// wins and interrupts the others, which are
+/// interrupted again until they stop.
+check_result race_query(solver &s, PortfolioStats &stats) {
+  stats.races++;
+  size_t n = g_solver_configs.size();
+  std::vector<std::unique_ptr<context>> contexts;
+  std::vector<solver> solvers;
+  expr_vector assertions = s.assertions();
+  // contexts are filled here, before any thread touches them
+  for(size_t i = 0; i < n; i++) {
+    contexts.emplace_back(new context());
+    context &c = *contexts.back();
+    solvers.push_back(make_config_solver(c, g_solver_configs[i]));
+    params p(c);
+    if(query_timeout() > 0) p.set("timeout", query_timeout());
+    if(g_options.rlimit > 0) p.set("rlimit", g_options.rlimit);
+    solvers.back().set(p);
+    for(unsigned a = 0; a < assertions.size(); a++)
+      solvers.back().add(to_expr(c, Z3_translate(s.ctx(), assertions[a], c)));
+  }
+
+  std::atomic<int> winner(-1);
+  std::unique_ptr<std::atomic<bool>[]> done(new std::atomic<bool>[n]());
+  std::vector<check_result> results(n, unknown);
+  std::vector<std::thread> threads;
+  for(size_t i = 0; i < n; i++)
+    threads.emplace_back([&, i]() {
+      if(winner.load() < 0) {
+        try {
+          results[i] = solvers[i].check();
+        }
+        catch(const z3::exception &) {
+          results[i] = unknown;
+        }
+        int none = -1;
+        if(results[i] != unknown) winner.compare_exchange_strong(none, i);
+      }
+      done[i] = true;
+    });
+  // An interrupt that lands before a thread enters check() is lost, so
+  // the losers are interrupted again until each of them has returned.
+  for(size_t j = 0; j < n; ) {
+    if(done[j]) {
+      j++;
+      continue;
+    }
+    if(winner.load() >= 0) contexts[j]->interrupt();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  for(auto &thread: threads) thread.join();
+
+  if(winner.load() < 0) {
+    stats.undecided++;
+    return unknown;
+  }
+  stats.wins[g_solver_configs[winner.load()]]++;
+  return results[winner.load()];
+}
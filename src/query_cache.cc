@@ -0,0 +1,174 @@
+#include "ctrd_prop.h"
+#include "util.h"
+#include "query_cache.h"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string.h>
+
+USING_YOSYS_NAMESPACE
+
+#define QCACHE_MAGIC 0x3143515144525443ull  // "CTRDQQC1"
+
+
+struct QueryCache::Header {
+  uint64_t magic;
+  uint64_t capacity;
+  uint64_t clock;
+  uint64_t reserved[5];
+};
+
+
+struct QueryCache::Entry {
+  uint64_t hi;
+  uint64_t lo;
+  int32_t result;
+  uint32_t stamp;
+};
+
+
+PRIVATE_NAMESPACE_BEGIN
+
+uint64_t mix(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ull;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebull;
+  return x ^ (x >> 31);
+}
+
+PRIVATE_NAMESPACE_END
+
+
+void QueryHasher::add(uint64_t word) {
+  hi = mix(hi ^ word) + 0x9e3779b97f4a7c15ull;
+  lo = mix(lo + word * 0xff51afd7ed558ccdull) ^ hi;
+}
+
+
+void QueryHasher::add(const std::string &str) {
+  add(str.size());
+  for(auto ch: str) add((uint8_t)ch);
+}
+
+
+QueryKey QueryHasher::key() const {
+  return QueryKey{mix(hi), mix(lo) | 1};
+}
+
+
+void CacheStats::log_summary(const std::string &path) const {
+  if(lookups == 0) return;
+  log("Query cache %s: %d of %d lookups hit, %d results stored, %d evicted.\n",
+      path.c_str(), hits, lookups, inserts, evictions);
+}
+
+
+/// Map `file`, creating it with room for `capacity` entries if it is
+/// new or not a cache. An existing cache keeps its own capacity.
+bool QueryCache::open(const std::string &file, uint64_t capacity) {
+  path = file;
+  fd = ::open(file.c_str(), O_RDWR | O_CREAT, 0644);
+  if(fd < 0) {
+    log_warning("Cannot open query cache %s: %s\n", file.c_str(), strerror(errno));
+    return false;
+  }
+  lock(true);
+  Header probe;
+  memset(&probe, 0, sizeof(probe));
+  struct stat st;
+  bool valid = fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(Header) &&
+               pread(fd, &probe, sizeof(probe), 0) == (ssize_t)sizeof(probe) &&
+               probe.magic == QCACHE_MAGIC &&
+               (off_t)(sizeof(Header) + probe.capacity * sizeof(Entry)) == st.st_size;
+  if(!valid) {
+    probe.magic = QCACHE_MAGIC;
+    probe.capacity = capacity;
+    probe.clock = 0;
+    // the zero-filled table is empty
+    if(ftruncate(fd, 0) != 0 ||
+       ftruncate(fd, sizeof(Header) + capacity * sizeof(Entry)) != 0 ||
+       pwrite(fd, &probe, sizeof(probe), 0) != (ssize_t)sizeof(probe)) {
+      log_warning("Cannot initialize query cache %s: %s\n", file.c_str(), strerror(errno));
+      unlock();
+      close();
+      return false;
+    }
+  }
+  bytes = sizeof(Header) + probe.capacity * sizeof(Entry);
+  void* map = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  unlock();
+  if(map == MAP_FAILED) {
+    log_warning("Cannot map query cache %s: %s\n", file.c_str(), strerror(errno));
+    close();
+    return false;
+  }
+  header = (Header*)map;
+  entries = (Entry*)((char*)map + sizeof(Header));
+  return true;
+}
+
+
+void QueryCache::close() {
+  if(header != nullptr) munmap(header, bytes);
+  if(fd >= 0) ::close(fd);
+  header = nullptr;
+  entries = nullptr;
+  fd = -1;
+}
+
+
+void QueryCache::lock(bool exclusive) {
+  while(flock(fd, exclusive ? LOCK_EX : LOCK_SH) != 0 && errno == EINTR) { }
+}
+
+
+void QueryCache::unlock() {
+  flock(fd, LOCK_UN);
+}
+
+
+bool QueryCache::lookup(const QueryKey &key, int &result) {
+  stats.lookups++;
+  uint64_t capacity = header->capacity;
+  for(uint64_t p = 0; p < QCACHE_PROBES; p++) {
+    const Entry &entry = entries[(key.hi + p) % capacity];
+    if(entry.hi == key.hi && entry.lo == key.lo) {
+      // a query some run gave up on is worth another try
+      if(entry.result == VERDICT_UNKNOWN) return false;
+      result = entry.result;
+      stats.hits++;
+      return true;
+    }
+    if(entry.lo == 0) break;
+  }
+  return false;
+}
+
+
+/// store or refresh a result; needs the exclusive lock
+void QueryCache::insert(const QueryKey &key, int result) {
+  uint64_t capacity = header->capacity;
+  uint32_t stamp = ++header->clock;
+  Entry* victim = nullptr;
+  for(uint64_t p = 0; p < QCACHE_PROBES; p++) {
+    Entry &entry = entries[(key.hi + p) % capacity];
+    if(entry.lo == 0 || (entry.hi == key.hi && entry.lo == key.lo)) {
+      if(entry.lo == 0) stats.inserts++;
+      victim = &entry;
+      break;
+    }
+    if(victim == nullptr || entry.stamp < victim->stamp) victim = &entry;
+  }
+  if(victim->lo != 0 && (victim->hi != key.hi || victim->lo != key.lo)) {
+    stats.evictions++;
+    stats.inserts++;
+  }
+  victim->hi = key.hi;
+  victim->lo = key.lo;
+  victim->result = result;
+  victim->stamp = stamp;
+}
@@ -0,0 +1,93 @@
+#include "ctrd_prop.h"
+#include "util.h"
+#include "bitsim.h"
+#include "query_dump.h"
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <fstream>
+#include <string.h>
+
+using namespace z3;
+
+USING_YOSYS_NAMESPACE
+
+
+bool QueryDumper::open(const std::string &path) {
+  if(mkdir(path.c_str(), 0755) != 0 && errno != EEXIST) {
+    log_warning("Cannot create query directory %s: %s\n", path.c_str(), strerror(errno));
+    return false;
+  }
+  dir = path;
+  count = 0;
+  return true;
+}
+
+
+void QueryDumper::dump(solver &s, const CheckSet &set, int coneSize, check_result result) {
+  char name[32];
+  snprintf(name, sizeof(name), "q%06d.smt2", count++);
+  std::string file = dir + "/" + prefix + name;
+  std::ofstream out(file);
+  if(!out) {
+    log_warning("Cannot write query %s.\n", file.c_str());
+    return;
+  }
+  out << "; opt_ctrd query\n";
+  out << "; cell: " << set.cell->name.str() << "\n";
+  out << "; type: " << set.cell->type.str() << "\n";
+  out << "; path: " << set.path << "\n";
+  out << "; cone: " << coneSize << "\n";
+  out << "; expected: " << result_name(result) << "\n";
+  out << s.to_smt2();
+}
+
+
+/// cells in the fanin of the candidate inside its module
+int cone_size(const NetSnapshot &snap, RTLIL::Cell* cell) {
+  int module = snap.module_id(cell->module);
+  if(module < 0) return 0;
+  const SnapModule &sm = snap.modules[module];
+  int id = sm.find_cell(cell->name.str());
+  return id < 0 ? 0 : fanin_cells(sm, {id}, {}).size();
+}
+
+
+std::string result_name(check_result result) {
+  return result == sat ? "sat" : result == unsat ? "unsat" : "unknown";
+}
+
+
+/// the .smt2 files of `dir` in name order
+std::vector<std::string> list_queries(const std::string &dir) {
+  std::vector<std::string> files;
+  DIR* handle = opendir(dir.c_str());
+  if(handle == nullptr) return files;
+  while(struct dirent* entry = readdir(handle)) {
+    std::string name = entry->d_name;
+    if(name.size() > 5 && name.compare(name.size() - 5, 5, ".smt2") == 0)
+      files.push_back(dir + "/" + name);
+  }
+  closedir(handle);
+  std::sort(files.begin(), files.end());
+  return files;
+}
+
+
+QueryInfo read_query_info(const std::string &file) {
+  QueryInfo info;
+  info.file = file;
+  std::ifstream in(file);
+  std::string line;
+  while(std::getline(in, line) && line.compare(0, 2, "; ") == 0) {
+    size_t colon = line.find(": ");
+    if(colon == std::string::npos) continue;
+    std::string key = line.substr(2, colon - 2), value = line.substr(colon + 2);
+    if(key == "cell") info.cell = value;
+    else if(key == "type") info.type = value;
+    else if(key == "path") info.path = value;
+    else if(key == "cone") info.cone = atoi(value.c_str());
+    else if(key == "expected") info.expected = value;
+  }
+  return info;
+}
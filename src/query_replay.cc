@@ -0,0 +1,171 @@
+#include "ctrd_prop.h"
+#include "util.h"
+#include "scheduler.h"
+#include "query_dump.h"
+#include "portfolio.h"
+
+#include <chrono>
+
+using namespace z3;
+
+USING_YOSYS_NAMESPACE
+PRIVATE_NAMESPACE_BEGIN
+
+struct ReplayResult {
+  double ms = 0;
+  check_result result = unknown;
+};
+
+
+struct ReplayStats {
+  int queries = 0;
+  int sat = 0;
+  int unsat = 0;
+  int unknown = 0;
+  int mismatches = 0;
+  double total = 0;
+  double worst = 0;
+
+  void add(const ReplayResult &r, bool mismatch) {
+    queries++;
+    if(r.result == z3::sat) sat++;
+    else if(r.result == z3::unsat) unsat++;
+    else unknown++;
+    if(mismatch) mismatches++;
+    total += r.ms;
+    worst = std::max(worst, r.ms);
+  }
+};
+
+
+/// solve one dumped query with one configuration in a context of its own
+ReplayResult replay_query(const std::string &file, const std::string &config, int timeout) {
+  context c;
+  solver s = make_config_solver(c, config);
+  if(timeout > 0) {
+    params p(c);
+    p.set("timeout", (unsigned)timeout);
+    s.set(p);
+  }
+  ReplayResult r;
+  try {
+    expr_vector assertions = c.parse_file(file.c_str());
+    auto start = std::chrono::steady_clock::now();
+    for(unsigned i = 0; i < assertions.size(); i++) s.add(assertions[i]);
+    r.result = s.check();
+    r.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  }
+  catch(const z3::exception &e) {
+    r.result = unknown;
+  }
+  return r;
+}
+
+
+struct ReplayPass : public Pass {
+  ReplayPass() : Pass("opt_ctrd_replay", "replay dumped opt_ctrd queries") { }
+  void help() override {
+    log("\n");
+    log("    opt_ctrd_replay [options] <dir>\n");
+    log("\n");
+    log("Solve every query written by 'opt_ctrd -dump-queries <dir>' with one or\n");
+    log("more solver configurations and report the time of each query and the\n");
+    log("totals per configuration. Answers that differ from the one recorded\n");
+    log("when the query was dumped are reported as mismatches.\n");
+    log("\n");
+    log("    -config <name>\n");
+    log("        add a configuration; may be given more than once. One of\n");
+    log("        default (Z3's default solver), qf_bv (the QF_BV logic solver),\n");
+    log("        qfbv (the qfbv tactic) and bitblast (simplify, bit-blast and\n");
+    log("        SAT). Without this option every configuration is run.\n");
+    log("\n");
+    log("    -timeout <ms>\n");
+    log("        give up on a query after this long (default: no limit).\n");
+    log("\n");
+    log("    -threads <N>\n");
+    log("        number of queries solved at once (default: all hardware\n");
+    log("        threads).\n");
+    log("\n");
+    log("    -quiet\n");
+    log("        only report the totals.\n");
+    log("\n");
+  }
+  void execute(std::vector<std::string> args, Design*) override {
+    log_header(nullptr, "Executing OPT_CTRD_REPLAY pass\n");
+    std::vector<std::string> configs;
+    int timeout = 0, threads = 0;
+    bool quiet = false;
+    size_t argidx;
+    for(argidx = 1; argidx < args.size(); argidx++) {
+      if(args[argidx] == "-config" && argidx + 1 < args.size()) {
+        std::string config = args[++argidx];
+        if(std::find(g_solver_configs.begin(), g_solver_configs.end(), config) == g_solver_configs.end())
+          log_cmd_error("Unknown solver configuration %s.\n", config.c_str());
+        configs.push_back(config);
+        continue;
+      }
+      if(args[argidx] == "-timeout" && argidx + 1 < args.size()) {
+        timeout = atoi(args[++argidx].c_str());
+        continue;
+      }
+      if(args[argidx] == "-threads" && argidx + 1 < args.size()) {
+        threads = atoi(args[++argidx].c_str());
+        continue;
+      }
+      if(args[argidx] == "-quiet") {
+        quiet = true;
+        continue;
+      }
+      break;
+    }
+    if(argidx + 1 != args.size())
+      log_cmd_error("Expected exactly one query directory.\n");
+    std::string dir = args[argidx];
+    if(configs.empty()) configs = g_solver_configs;
+
+    std::vector<std::string> files = list_queries(dir);
+    if(files.empty())
+      log_cmd_error("No .smt2 queries in %s.\n", dir.c_str());
+    std::vector<QueryInfo> infos;
+    for(auto &file: files) infos.push_back(read_query_info(file));
+
+    std::vector<ReplayResult> results(files.size() * configs.size());
+    TaskScheduler sched(threads);
+    for(size_t q = 0; q < files.size(); q++)
+      for(size_t k = 0; k < configs.size(); k++) {
+        size_t slot = q * configs.size() + k;
+        std::string file = files[q], config = configs[k];
+        sched.spawn(-1, [&results, slot, file, config, timeout](int) {
+          results[slot] = replay_query(file, config, timeout);
+        });
+      }
+    sched.run();
+
+    std::vector<ReplayStats> totals(configs.size());
+    for(size_t q = 0; q < files.size(); q++) {
+      const QueryInfo &info = infos[q];
+      for(size_t k = 0; k < configs.size(); k++) {
+        const ReplayResult &r = results[q * configs.size() + k];
+        std::string answer = result_name(r.result);
+        // an unknown answer is a timeout, not a wrong one
+        bool mismatch = r.result != z3::unknown && !info.expected.empty() &&
+                        info.expected != "unknown" && info.expected != answer;
+        totals[k].add(r, mismatch);
+        if(!quiet)
+          log("  %s %-8s %10.3f ms  %-7s %s %s%s (cone %d)%s\n", info.file.c_str(), configs[k].c_str(),
+              r.ms, answer.c_str(), info.type.c_str(), info.path.c_str(),
+              info.path.empty() ? info.cell.c_str() : ("." + info.cell).c_str(), info.cone,
+              mismatch ? "  MISMATCH" : "");
+      }
+    }
+    log("\nReplayed %d queries from %s on %d threads.\n", (int)files.size(), dir.c_str(), sched.threads());
+    for(size_t k = 0; k < configs.size(); k++) {
+      const ReplayStats &t = totals[k];
+      log("  %-8s total %10.1f ms, mean %8.3f ms, max %8.3f ms; %d sat, %d unsat, %d unknown, %d mismatches\n",
+          configs[k].c_str(), t.total, t.total / std::max(1, t.queries), t.worst,
+          t.sat, t.unsat, t.unknown, t.mismatches);
+    }
+  }
+} ReplayPass;
+
+PRIVATE_NAMESPACE_END
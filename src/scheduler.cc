@@ -0,0 +1,115 @@
+#include "ctrd_prop.h"
+#include "scheduler.h"
+#include <thread>
+
+USING_YOSYS_NAMESPACE
+
+
+void SchedStats::add(const SchedStats &other) {
+  tasks += other.tasks;
+  steals += other.steals;
+  failedSteals += other.failedSteals;
+  idle += other.idle;
+}
+
+
+void SchedStats::log_summary(int threads) const {
+  log("Ran %ld tasks on %d workers: %ld steals, %ld failed steals, %ld idle rounds.\n",
+      tasks, threads, steals, failedSteals, idle);
+}
+
+
+TaskScheduler::TaskScheduler(int threads) : pending(0), queued(0) {
+  if(threads <= 0) threads = std::max(1u, std::thread::hardware_concurrency());
+  for(int i = 0; i < threads; i++)
+    queues.emplace_back(new WorkerQueue());
+}
+
+
+/// queue a task on a worker; -1 from outside the pool picks worker 0
+void TaskScheduler::spawn(int worker, Task_t task) {
+  WorkerQueue &queue = *queues[worker < 0 ? 0 : worker];
+  // counted before it is visible, so no worker can see zero pending
+  // while the task is still queued
+  pending++;
+  {
+    std::lock_guard<std::mutex> guard(queue.lock);
+    queue.tasks.push_back(std::move(task));
+  }
+  queued++;
+  notify(false);
+}
+
+
+/// wake sleeping workers; taking the lock keeps a worker that is about
+/// to sleep from missing the wake-up
+void TaskScheduler::notify(bool all) {
+  std::lock_guard<std::mutex> guard(idleLock);
+  if(all) wake.notify_all();
+  else wake.notify_one();
+}
+
+
+bool TaskScheduler::pop(int worker, Task_t &task) {
+  WorkerQueue &queue = *queues[worker];
+  std::lock_guard<std::mutex> guard(queue.lock);
+  if(queue.tasks.empty()) return false;
+  task = std::move(queue.tasks.back());
+  queue.tasks.pop_back();
+  return true;
+}
+
+
+bool TaskScheduler::steal(int worker, Task_t &task) {
+  int n = queues.size();
+  for(int k = 1; k < n; k++) {
+    WorkerQueue &victim = *queues[(worker + k) % n];
+    std::lock_guard<std::mutex> guard(victim.lock);
+    if(victim.tasks.empty()) continue;
+    task = std::move(victim.tasks.front());
+    victim.tasks.pop_front();
+    return true;
+  }
+  return false;
+}
+
+
+void TaskScheduler::work(int worker) {
+  SchedStats &stats = queues[worker]->stats;
+  Task_t task;
+  while(pending > 0) {
+    bool found = pop(worker, task);
+    if(!found && queues.size() > 1) {
+      found = steal(worker, task);
+      if(found) stats.steals++;
+      else stats.failedSteals++;
+    }
+    if(!found) {
+      stats.idle++;
+      std::unique_lock<std::mutex> guard(idleLock);
+      wake.wait(guard, [this]() { return queued > 0 || pending == 0; });
+      continue;
+    }
+    queued--;
+    task(worker);
+    stats.tasks++;
+    // spawned children were counted before this one is released
+    if(--pending == 0) notify(true);
+  }
+}
+
+
+void TaskScheduler::run() {
+  std::vector<std::thread> pool;
+  for(size_t i = 1; i < queues.size(); i++)
+    pool.emplace_back(&TaskScheduler::work, this, i);
+  work(0);
+  for(auto &t: pool) t.join();
+}
+
+
+SchedStats TaskScheduler::stats() const {
+  SchedStats total;
+  for(auto &queue: queues) total.add(queue->stats);
+  return total;
+}
@@ -0,0 +1,229 @@
+#include "ctrd_prop.h"
+#include "util.h"
+#include "session.h"
+
+#include <climits>
+
+using namespace z3;
+
+USING_YOSYS_NAMESPACE
+
+CtrdSession g_session;
+
+
+void SessionStats::log_summary() const {
+  if(runs == 0) return;
+  log("Session run %d: %d instances reused, %d encoded, %d retired; %d facts added, %d already known.\n",
+      runs, reused, encoded, retired, facts, skipped);
+}
+
+
+/// Hash of everything propagation reads from a module. Equal modules
+/// built in a different order hash differently, which only costs a
+/// re-encode.
+QueryKey module_hash(RTLIL::Module* module) {
+  QueryHasher hasher;
+  hasher.add(module->name.str());
+  for(auto wire: module->wires()) {
+    hasher.add(wire->name.str());
+    hasher.add(wire->width);
+    hasher.add(wire->port_id);
+    hasher.add(wire->port_input + 2 * wire->port_output);
+  }
+  for(auto cell: module->cells()) {
+    hasher.add(cell->name.str());
+    hasher.add(cell->type.str());
+    for(auto &param: cell->parameters) {
+      hasher.add(param.first.str());
+      hasher.add(param.second.as_string());
+    }
+    for(auto &conn: cell->connections_) {
+      hasher.add(conn.first.str());
+      hasher.add(log_signal(conn.second));
+    }
+  }
+  for(auto &conn: module->connections()) {
+    hasher.add(log_signal(conn.first));
+    hasher.add(log_signal(conn.second));
+  }
+  return hasher.key();
+}
+
+
+/// Open a run on `d`: retire the guards of modules that changed or are
+/// gone and open the scope of the run. The remaining guards are asserted
+/// in it as the run reaches their instances.
+void CtrdSession::begin(Design* d) {
+  // a run that ended in an error leaves its scope open
+  if(running) {
+    for(unsigned i = 0; i < pending->size(); i++) known.erase(Z3_get_ast_id(*c, (*pending)[i]));
+    s->pop();
+    running = false;
+  }
+  if(d != design) {
+    // the old design may be gone already, so it is not touched
+    release();
+    design = d;
+    design->monitors.insert(this);
+  }
+  if(!c) {
+    c.reset(new context);
+    s.reset(new solver(*c));
+  }
+  stats = SessionStats();
+  stats.runs = ++runs;
+  // most modules have several instances
+  std::map<std::string, QueryKey> hashes;
+  for(auto it = instances.begin(); it != instances.end(); ) {
+    RTLIL::Module* module = design->module(RTLIL::IdString(it->second.module));
+    if(module && !hashes.count(it->second.module)) hashes[it->second.module] = module_hash(module);
+    QueryKey hash = module ? hashes[it->second.module] : QueryKey{0, 0};
+    if(module && hash.hi == it->second.hash.hi && hash.lo == it->second.hash.lo) {
+      stats.reused++;
+      ++it;
+      continue;
+    }
+    retired.push_back(it->second.guard);
+    it = instances.erase(it);
+  }
+  for(auto &name: retired) s->add(!c->bool_const(name.c_str()));
+  stats.retired = retired.size();
+  retired.clear();
+  // limits of the previous run stay on the solver otherwise
+  params p(*c);
+  p.set("timeout", UINT_MAX);
+  p.set("rlimit", 0u);
+  s->set(p);
+  s->push();
+  active.clear();
+  visited = 0;
+  pending.reset(new expr_vector(*c));
+  running = true;
+}
+
+
+/// Close the run and keep the facts it found for the next one.
+void CtrdSession::end() {
+  if(!running) return;
+  running = false;
+  s->pop();
+  for(unsigned i = 0; i < pending->size(); i++) s->add((*pending)[i]);
+  pending.reset();
+  stats.log_summary();
+}
+
+
+void CtrdSession::release() {
+  running = false;
+  pending.reset();
+  s.reset();
+  c.reset();
+  instances.clear();
+  active.clear();
+  retired.clear();
+  known.clear();
+}
+
+
+/// The guard of the facts of `instance`, made when it is first encoded.
+/// The run has found the module on the path, so the guard holds in it.
+expr CtrdSession::guard(const Instance &instance) {
+  std::string name = instance.path + " " + instance.module->name.str();
+  auto it = instances.find(name);
+  if(it == instances.end()) {
+    std::string guardName = "ctrd_session_" + std::to_string(runs) + "_" + name;
+    InstanceEncoding encoding{instance.module->name.str(), module_hash(instance.module), guardName};
+    it = instances.insert(std::make_pair(name, encoding)).first;
+    stats.encoded++;
+  }
+  if(active.insert(name).second) s->add(c->bool_const(it->second.guard.c_str()));
+  return c->bool_const(it->second.guard.c_str());
+}
+
+
+/// Assert the guards of the instances propagation has walked so far,
+/// which brings back their facts from earlier runs.
+void CtrdSession::visit() {
+  size_t paths = 0;
+  for(auto &pair: g_visited_paths) paths += pair.second.size();
+  // paths are only ever added during a run
+  if(paths == visited) return;
+  visited = paths;
+  for(auto &pair: g_visited_paths)
+    for(auto &path: pair.second)
+      if(instances.count(path + " " + pair.first->name.str()))
+        guard(Instance{path, pair.first});
+}
+
+
+/// Assert `fact` for the instances in `about`. Facts are hash-consed, so
+/// one seen in an earlier run under the same guards is already in the
+/// solver.
+void CtrdSession::add(const expr &fact, const std::vector<Instance> &about) {
+  expr guards = c->bool_val(true);
+  for(auto &instance: about) guards = guards && guard(instance);
+  expr guarded = implies(guards, fact);
+  unsigned id = Z3_get_ast_id(*c, guarded);
+  if(known.count(id)) {
+    stats.skipped++;
+    return;
+  }
+  known.insert(id);
+  s->add(guarded);
+  // keeps the id from being reused until the fact is at the base level
+  pending->push_back(guarded);
+  stats.facts++;
+}
+
+
+void CtrdSession::notify_module_del(RTLIL::Module* module) {
+  if(module->design != design) return;
+  // the monitor cannot leave the design from inside its own callback
+  if(design->modules_.size() <= 1) {
+    release();
+    return;
+  }
+  for(auto it = instances.begin(); it != instances.end(); ) {
+    if(it->second.module != module->name.str()) {
+      ++it;
+      continue;
+    }
+    retired.push_back(it->second.guard);
+    it = instances.erase(it);
+  }
+}
+
+
+/// Assert a propagation fact, through the session if one is running.
+void assert_fact(solver &s, const expr &fact, const std::vector<Instance> &about) {
+  if(g_session.running) g_session.add(fact, about);
+  else s.add(fact);
+}
+
+
+PRIVATE_NAMESPACE_BEGIN
+
+struct CtrdFlushPass : public Pass {
+  CtrdFlushPass() : Pass("opt_ctrd_flush", "release the opt_ctrd session solver") { }
+  void help() override {
+    log("\n");
+    log("    opt_ctrd_flush\n");
+    log("\n");
+    log("Release the solver kept between 'opt_ctrd -session' runs, with every\n");
+    log("instance encoding in it. The next run with -session starts afresh.\n");
+    log("\n");
+  }
+  void execute(std::vector<std::string> args, Design* design) override {
+    log_header(design, "Executing OPT_CTRD_FLUSH pass\n");
+    extra_args(args, 1, design);
+    int instances = g_session.instances.size();
+    g_session.release();
+    if(g_session.design == design) {
+      design->monitors.erase(&g_session);
+      g_session.design = nullptr;
+    }
+    log("Released %d instance encodings.\n", instances);
+  }
+} CtrdFlushPass;
+
+PRIVATE_NAMESPACE_END
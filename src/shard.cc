@@ -0,0 +1,148 @@
+#include "ctrd_prop.h"
+#include "util.h"
+#include "shard.h"
+
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <string.h>
+
+USING_YOSYS_NAMESPACE
+
+
+void ShardStats::log_summary() const {
+  if(procs == 0) return;
+  log("Sharded the final check over %d processes: %d verdicts received.\n", procs, records);
+  if(failed > 0)
+    log_warning("%d worker processes failed; their candidates are left untouched.\n", failed);
+}
+
+
+PRIVATE_NAMESPACE_BEGIN
+
+// what a worker sends back for each of its candidates
+struct VerdictRecord {
+  int32_t candidate;
+  int32_t value;
+};
+
+
+bool write_all(int fd, const char* data, size_t size) {
+  while(size > 0) {
+    ssize_t n = write(fd, data, size);
+    if(n < 0 && errno == EINTR) continue;
+    if(n <= 0) return false;
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+PRIVATE_NAMESPACE_END
+
+
+/// Deal the cells out round-robin in payoff order, so every worker gets
+/// a share of the valuable candidates. All paths of a cell go to the
+/// same worker.
+std::vector<int> assign_shards(const std::vector<int> &ranked, int procs) {
+  std::vector<int> shardOf(g_check_vec.size(), -1);
+  dict<RTLIL::Cell*, int> cellShard;
+  for(auto k: ranked) {
+    RTLIL::Cell* cell = g_check_vec[k].cell;
+    if(!cellShard.count(cell)) {
+      int next = cellShard.size() % procs;
+      cellShard[cell] = next;
+    }
+    shardOf[k] = cellShard.at(cell);
+  }
+  return shardOf;
+}
+
+
+/// Fork one worker per shard. The workers see the parent's solver and
+/// netlist copy-on-write, run `work` and send their answers back over a
+/// pipe. Candidates of a worker that fails stay at -1.
+std::vector<int> run_sharded(int procs, const std::vector<int> &shardOf, ShardWork_t work,
+                             ShardStats &stats) {
+  stats.procs = procs;
+  std::vector<int> values(shardOf.size(), -1);
+  std::vector<int> expected(procs, 0);
+  for(auto shard: shardOf)
+    if(shard >= 0) expected[shard]++;
+  fflush(stdout);
+  fflush(stderr);
+
+  std::vector<pid_t> pids;
+  std::vector<int> fds;
+  for(int shard = 0; shard < procs; shard++) {
+    int pipefd[2];
+    if(pipe(pipefd) != 0) log_error("pipe() failed: %s\n", strerror(errno));
+    pid_t pid = fork();
+    if(pid < 0) log_error("fork() failed: %s\n", strerror(errno));
+    if(pid == 0) {
+      close(pipefd[0]);
+      for(auto fd: fds) close(fd);
+      std::vector<int> answers = work(shard);
+      std::vector<VerdictRecord> records;
+      for(size_t k = 0; k < shardOf.size(); k++)
+        if(shardOf[k] == shard) records.push_back(VerdictRecord{(int32_t)k, answers[k]});
+      bool ok = write_all(pipefd[1], (const char*)records.data(), records.size() * sizeof(VerdictRecord));
+      // skip the parent's exit handlers
+      _exit(ok ? 0 : 1);
+    }
+    close(pipefd[1]);
+    pids.push_back(pid);
+    fds.push_back(pipefd[0]);
+  }
+
+  // drain all pipes at once so no worker blocks on a full one
+  std::vector<std::string> buffers(procs);
+  std::vector<bool> open(procs, true);
+  int remaining = procs;
+  while(remaining > 0) {
+    std::vector<pollfd> polls;
+    std::vector<int> shards;
+    for(int shard = 0; shard < procs; shard++)
+      if(open[shard]) {
+        polls.push_back(pollfd{fds[shard], POLLIN, 0});
+        shards.push_back(shard);
+      }
+    if(poll(polls.data(), polls.size(), -1) < 0) {
+      if(errno == EINTR) continue;
+      log_error("poll() failed: %s\n", strerror(errno));
+    }
+    for(size_t i = 0; i < polls.size(); i++) {
+      if(polls[i].revents == 0) continue;
+      char chunk[4096];
+      ssize_t n = read(polls[i].fd, chunk, sizeof(chunk));
+      if(n < 0 && errno == EINTR) continue;
+      if(n > 0) {
+        buffers[shards[i]].append(chunk, n);
+        continue;
+      }
+      open[shards[i]] = false;
+      remaining--;
+    }
+  }
+
+  // applied in shard order, whatever order the workers finished in
+  for(int shard = 0; shard < procs; shard++) {
+    close(fds[shard]);
+    int status = 0;
+    while(waitpid(pids[shard], &status, 0) < 0 && errno == EINTR) { }
+    const std::string &buffer = buffers[shard];
+    size_t count = buffer.size() / sizeof(VerdictRecord);
+    if(!WIFEXITED(status) || WEXITSTATUS(status) != 0 || (int)count != expected[shard]) {
+      stats.failed++;
+      continue;
+    }
+    for(size_t r = 0; r < count; r++) {
+      VerdictRecord record;
+      memcpy(&record, buffer.data() + r * sizeof(record), sizeof(record));
+      int k = record.candidate;
+      if(k >= 0 && k < (int)values.size() && shardOf[k] == shard) values[k] = record.value;
+    }
+    stats.records += count;
+  }
+  return values;
+}
@@ -0,0 +1,240 @@
+#include "ctrd_prop.h"
+#include "util.h"
+#include "snapshot.h"
+
+USING_YOSYS_NAMESPACE
+
+NetSnapshot g_snapshot;
+
+
+BitRange SnapModule::wire_bits(int wire) const {
+  const int* first = bits.data() + wireBit[wire];
+  return BitRange{first, first + wireWidth[wire]};
+}
+
+
+BitRange SnapModule::conn_bits(int conn) const {
+  return BitRange{bits.data() + connBit[conn], bits.data() + connBit[conn + 1]};
+}
+
+
+int SnapModule::find_conn(int cell, int name) const {
+  for(int j = cellConn[cell]; j < cellConn[cell + 1]; j++)
+    if(connName[j] == name) return j;
+  return -1;
+}
+
+
+int SnapModule::find_wire(const std::string &name) const {
+  auto it = wireIds.find(name);
+  return it == wireIds.end() ? -1 : it->second;
+}
+
+
+int SnapModule::find_cell(const std::string &name) const {
+  auto it = cellIds.find(name);
+  return it == cellIds.end() ? -1 : it->second;
+}
+
+
+/// bits of a named connection, empty if the cell has no such port
+BitRange SnapModule::cell_bits(int cell, int name) const {
+  int conn = find_conn(cell, name);
+  if(conn < 0) return BitRange{nullptr, nullptr};
+  return conn_bits(conn);
+}
+
+
+PRIVATE_NAMESPACE_BEGIN
+
+SnapOp snap_op(RTLIL::Cell* cell) {
+  static const dict<RTLIL::IdString, SnapOp> ops = {
+    {ID($not), OP_NOT}, {ID($and), OP_AND}, {ID($or), OP_OR},
+    {ID($xor), OP_XOR}, {ID($xnor), OP_XNOR},
+    {ID($reduce_and), OP_REDUCE_AND}, {ID($reduce_or), OP_REDUCE_OR},
+    {ID($reduce_xor), OP_REDUCE_XOR}, {ID($reduce_bool), OP_REDUCE_BOOL},
+    {ID($logic_not), OP_LOGIC_NOT}, {ID($logic_and), OP_LOGIC_AND}, {ID($logic_or), OP_LOGIC_OR},
+    {ID($eq), OP_EQ}, {ID($ne), OP_NE}, {ID($mux), OP_MUX}, {ID($pmux), OP_PMUX}
+  };
+  auto it = ops.find(cell->type);
+  if(it == ops.end()) return OP_UNKNOWN;
+  // sign extension is not modelled
+  for(auto param: {ID::A_SIGNED, ID::B_SIGNED})
+    if(cell->hasParam(param) && cell->getParam(param).as_bool()) return OP_UNKNOWN;
+  return it->second;
+}
+
+
+struct SnapBuilder {
+  NetSnapshot &snap;
+  std::map<std::string, int> nameIds;
+
+  int intern(const std::string &name) {
+    auto it = nameIds.find(name);
+    if(it != nameIds.end()) return it->second;
+    nameIds[name] = snap.names.size();
+    snap.names.push_back(name);
+    return snap.names.size() - 1;
+  }
+
+  void build_module(Design* design, RTLIL::Module* module, SnapModule &sm);
+  void sort_cells(SnapModule &sm);
+};
+
+
+void SnapBuilder::build_module(Design* design, RTLIL::Module* module, SnapModule &sm) {
+  sm.name = module->name.str();
+  SigMap sigmap(module);
+  dict<RTLIL::SigBit, int> bitIds;
+  auto add_bits = [&](RTLIL::SigSpec sig) {
+    for(auto bit: sigmap(sig)) {
+      int id;
+      if(bit.wire == nullptr)
+        id = bit.data == RTLIL::State::S0 ? BIT_CONST0 :
+             bit.data == RTLIL::State::S1 ? BIT_CONST1 : BIT_CONSTX;
+      else if(bitIds.count(bit)) id = bitIds.at(bit);
+      else {
+        id = sm.numBits++;
+        bitIds[bit] = id;
+      }
+      sm.bits.push_back(id);
+    }
+  };
+
+  dict<RTLIL::IdString, int> wireIds;
+  for(auto wirePair: module->wires_) {
+    RTLIL::Wire* wire = wirePair.second;
+    wireIds[wire->name] = sm.wireName.size();
+    sm.wireIds[wire->name.str()] = sm.wireName.size();
+    sm.wireName.push_back(wire->name.str());
+    sm.wireWidth.push_back(wire->width);
+    sm.wireBit.push_back(sm.bits.size());
+    add_bits(RTLIL::SigSpec(wire));
+  }
+  sm.wirePort.assign(sm.wireName.size(), -1);
+  for(auto portName: module->ports) {
+    RTLIL::Wire* wire = module->wire(portName);
+    sm.wirePort[wireIds.at(portName)] = sm.portWire.size();
+    sm.portWire.push_back(wireIds.at(portName));
+    sm.portDir.push_back((wire->port_input ? PORT_IN : 0) | (wire->port_output ? PORT_OUT : 0));
+  }
+
+  for(auto cellPair: module->cells_) {
+    RTLIL::Cell* cell = cellPair.second;
+    sm.cellIds[cell->name.str()] = sm.cellName.size();
+    sm.cellName.push_back(cell->name.str());
+    sm.cellOp.push_back(snap_op(cell));
+    sm.cellChild.push_back(-1);
+    sm.cellConn.push_back(sm.connName.size());
+    auto add_conn = [&](RTLIL::IdString port, uint8_t dir, RTLIL::SigSpec sig) {
+      sm.connName.push_back(intern(port.str()));
+      sm.connDir.push_back(dir);
+      sm.connBit.push_back(sm.bits.size());
+      add_bits(sig);
+    };
+    RTLIL::Module* childMod = design->module(cell->type);
+    if(childMod != nullptr && snap.index.count(childMod)) {
+      sm.cellOp.back() = OP_INSTANCE;
+      sm.cellChild.back() = snap.index.at(childMod);
+      for(auto portName: childMod->ports) {
+        RTLIL::Wire* wire = childMod->wire(portName);
+        RTLIL::SigSpec sig = cell->hasPort(portName) ? cell->getPort(portName)
+                                                     : RTLIL::SigSpec(RTLIL::State::Sx, wire->width);
+        add_conn(portName, (wire->port_input ? PORT_IN : 0) | (wire->port_output ? PORT_OUT : 0), sig);
+      }
+      continue;
+    }
+    for(auto &conn: cell->connections_)
+      add_conn(conn.first, (cell->input(conn.first) ? PORT_IN : 0) |
+                           (cell->output(conn.first) ? PORT_OUT : 0), conn.second);
+  }
+  sm.cellConn.push_back(sm.connName.size());
+  sm.connBit.push_back(sm.bits.size());
+  sort_cells(sm);
+}
+
+
+/// order the cells so that every driver comes before its readers
+void SnapBuilder::sort_cells(SnapModule &sm) {
+  int numCells = sm.num_cells();
+  std::vector<int> driver(sm.numBits, -1);
+  for(int i = 0; i < numCells; i++)
+    for(int j = sm.cellConn[i]; j < sm.cellConn[i + 1]; j++)
+      if(sm.connDir[j] & PORT_OUT)
+        for(auto bit: sm.conn_bits(j))
+          if(bit > BIT_CONSTX) driver[bit] = i;
+
+  std::vector<std::vector<int>> readers(numCells);
+  std::vector<int> pending(numCells, 0);
+  for(int i = 0; i < numCells; i++) {
+    std::set<int> deps;
+    for(int j = sm.cellConn[i]; j < sm.cellConn[i + 1]; j++)
+      if(sm.connDir[j] == PORT_IN)
+        for(auto bit: sm.conn_bits(j))
+          if(driver[bit] >= 0 && driver[bit] != i) deps.insert(driver[bit]);
+    pending[i] = deps.size();
+    for(auto dep: deps) readers[dep].push_back(i);
+  }
+  std::vector<bool> placed(numCells, false);
+  for(int i = 0; i < numCells; i++)
+    if(pending[i] == 0) sm.order.push_back(i);
+  for(size_t k = 0; k < sm.order.size(); k++) {
+    placed[sm.order[k]] = true;
+    for(auto r: readers[sm.order[k]])
+      if(--pending[r] == 0) sm.order.push_back(r);
+  }
+  // cells on combinational loops go last and see x on the loop
+  for(int i = 0; i < numCells; i++)
+    if(!placed[i]) sm.order.push_back(i);
+
+  for(int i = 0; i < numCells; i++)
+    if(sm.cellChild[i] >= 0) sm.children.push_back(sm.cellChild[i]);
+  std::sort(sm.children.begin(), sm.children.end());
+  sm.children.erase(std::unique(sm.children.begin(), sm.children.end()), sm.children.end());
+}
+
+PRIVATE_NAMESPACE_END
+
+
+/// copy every non-blackbox module of the design
+void NetSnapshot::build(Design* design) {
+  clear();
+  SnapBuilder builder{*this, std::map<std::string, int>()};
+  for(auto name: {ID::A, ID::B, ID::S, ID::Y})
+    builder.intern(name.str());
+  for(auto modPair: design->modules_) {
+    if(modPair.second->get_blackbox_attribute()) continue;
+    index[modPair.second] = sources.size();
+    sources.push_back(modPair.second);
+  }
+  modules.resize(sources.size());
+  int cells = 0, bits = 0;
+  for(size_t i = 0; i < sources.size(); i++) {
+    builder.build_module(design, sources[i], modules[i]);
+    cells += modules[i].num_cells();
+    bits += modules[i].numBits;
+  }
+  log("Snapshot of %d modules: %d cells, %d bits, %d names.\n",
+      (int)modules.size(), cells, bits, (int)names.size());
+}
+
+
+int NetSnapshot::module_id(RTLIL::Module* module) const {
+  auto it = index.find(module);
+  return it == index.end() ? -1 : it->second;
+}
+
+
+int NetSnapshot::port_id(int module, const std::string &name) const {
+  const SnapModule &sm = modules[module];
+  int wire = sm.find_wire(name);
+  return wire < 0 ? -1 : sm.wirePort[wire];
+}
+
+
+void NetSnapshot::clear() {
+  modules.clear();
+  names.clear();
+  index.clear();
+  sources.clear();
+}
@@ -0,0 +1,78 @@
+#include "sop.h"
+#include <algorithm>
+#include <set>
+
+
+int cover_literals(const std::vector<Cube> &cover) {
+  int count = 0;
+  for(auto &cube: cover)
+    count += cube.literals();
+  return count;
+}
+
+
+std::vector<Cube> minimize_sop(int width, const std::vector<uint32_t> &on,
+                               const std::vector<uint32_t> &dc) {
+  uint32_t full = width >= 32 ? ~0u : (1u << width) - 1;
+  std::set<Cube> current;
+  for(auto m: on) current.insert(Cube{m & full, full});
+  for(auto m: dc) current.insert(Cube{m & full, full});
+
+  // merge cubes that differ in one literal until nothing changes
+  std::set<Cube> primes;
+  while(!current.empty()) {
+    std::set<Cube> next;
+    std::set<Cube> merged;
+    for(auto a = current.begin(); a != current.end(); ++a) {
+      for(auto b = std::next(a); b != current.end(); ++b) {
+        if(a->mask != b->mask) continue;
+        uint32_t diff = a->value ^ b->value;
+        if(__builtin_popcount(diff) != 1) continue;
+        next.insert(Cube{a->value & ~diff, a->mask & ~diff});
+        merged.insert(*a);
+        merged.insert(*b);
+      }
+    }
+    for(auto &cube: current)
+      if(!merged.count(cube)) primes.insert(cube);
+    current.swap(next);
+  }
+
+  // essential primes first, then the prime covering most leftovers
+  std::vector<Cube> cover;
+  std::set<uint32_t> left(on.begin(), on.end());
+  for(auto m: on) {
+    if(!left.count(m)) continue;
+    const Cube* only = nullptr;
+    int hits = 0;
+    for(auto &cube: primes)
+      if(cube.covers(m)) {
+        only = &cube;
+        hits++;
+      }
+    if(hits != 1) continue;
+    cover.push_back(*only);
+    for(auto it = left.begin(); it != left.end();)
+      it = only->covers(*it) ? left.erase(it) : std::next(it);
+  }
+  while(!left.empty()) {
+    const Cube* best = nullptr;
+    int bestHits = 0;
+    for(auto &cube: primes) {
+      int hits = 0;
+      for(auto m: left)
+        if(cube.covers(m)) hits++;
+      if(hits > bestHits || (hits == bestHits && best != nullptr && hits > 0 &&
+                             cube.literals() < best->literals())) {
+        best = &cube;
+        bestHits = hits;
+      }
+    }
+    cover.push_back(*best);
+    for(auto it = left.begin(); it != left.end();)
+      it = best->covers(*it) ? left.erase(it) : std::next(it);
+  }
+  std::sort(cover.begin(), cover.end());
+  cover.erase(std::unique(cover.begin(), cover.end()), cover.end());
+  return cover;
+}
@@ -0,0 +1,393 @@
+#include "ctrd_prop.h"
+#include "util.h"
+#include "netlist_edit.h"
+#include "snapshot.h"
+#include "facts.h"
+#include "summary.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+USING_YOSYS_NAMESPACE
+
+std::vector<ModuleSummary> g_summaries;
+std::vector<PortFact> g_port_facts;
+
+
+PRIVATE_NAMESPACE_BEGIN
+
+Tern t_not(Tern a) { return a == TX ? TX : a == T0 ? T1 : T0; }
+Tern t_and(Tern a, Tern b) { return (a == T0 || b == T0) ? T0 : (a == T1 && b == T1) ? T1 : TX; }
+Tern t_or(Tern a, Tern b) { return (a == T1 || b == T1) ? T1 : (a == T0 && b == T0) ? T0 : TX; }
+Tern t_xor(Tern a, Tern b) { return (a == TX || b == TX) ? TX : a == b ? T0 : T1; }
+
+
+Tern tern_bit(const std::vector<Tern> &val, BitRange sig, size_t i) {
+  return i < sig.size() ? val[sig[i]] : T0;
+}
+
+
+Tern reduce_or(const std::vector<Tern> &val, BitRange sig) {
+  Tern r = T0;
+  for(auto bit: sig) r = t_or(r, val[bit]);
+  return r;
+}
+
+
+void set_bits(std::vector<Tern> &val, BitRange sig, Tern first) {
+  for(size_t i = 0; i < sig.size(); i++)
+    if(sig[i] > BIT_CONSTX) val[sig[i]] = i == 0 ? first : T0;
+}
+
+
+/// apply the summary of an instantiated module
+void eval_instance(const NetSnapshot &snap, const SnapModule &sm, int cell,
+                   std::vector<Tern> &val, const std::vector<ModuleSummary> &summaries) {
+  int child = sm.cellChild[cell];
+  if(child >= (int)summaries.size()) return;
+  const SnapModule &cm = snap.modules[child];
+  int conn = sm.cellConn[cell];
+  std::vector<Tern> out;
+  for(size_t p = 0; p < cm.portWire.size(); p++)
+    if(cm.portDir[p] & PORT_OUT) out.resize(out.size() + cm.wireWidth[cm.portWire[p]], TX);
+  for(auto &transfer: summaries[child].transfers) {
+    uint32_t v = 0;
+    bool known = true;
+    BitRange in = sm.conn_bits(conn + transfer.input);
+    for(size_t i = 0; i < in.size(); i++) {
+      if(val[in[i]] == TX) known = false;
+      if(val[in[i]] == T1) v |= 1u << i;
+    }
+    if(!known) continue;
+    const std::vector<Tern> &row = transfer.table[v];
+    for(size_t k = 0; k < out.size(); k++)
+      if(row[k] != TX) out[k] = row[k];
+  }
+  size_t k = 0;
+  for(size_t p = 0; p < cm.portWire.size(); p++) {
+    if(!(cm.portDir[p] & PORT_OUT)) continue;
+    for(auto bit: sm.conn_bits(conn + p)) {
+      if(bit > BIT_CONSTX) val[bit] = out[k];
+      k++;
+    }
+  }
+}
+
+
+void eval_cell(const NetSnapshot &snap, const SnapModule &sm, int cell,
+               std::vector<Tern> &val, const std::vector<ModuleSummary> &summaries) {
+  SnapOp op = sm.cellOp[cell];
+  if(op == OP_UNKNOWN) return;
+  if(op == OP_INSTANCE) {
+    eval_instance(snap, sm, cell, val, summaries);
+    return;
+  }
+  BitRange a = sm.cell_bits(cell, NAME_A);
+  BitRange b = sm.cell_bits(cell, NAME_B);
+  BitRange y = sm.cell_bits(cell, NAME_Y);
+  size_t width = y.size();
+  switch(op) {
+  case OP_NOT:
+    for(size_t i = 0; i < width; i++) val[y[i]] = t_not(tern_bit(val, a, i));
+    break;
+  case OP_AND: case OP_OR: case OP_XOR: case OP_XNOR:
+    for(size_t i = 0; i < width; i++) {
+      Tern ta = tern_bit(val, a, i), tb = tern_bit(val, b, i);
+      Tern r = op == OP_AND ? t_and(ta, tb) : op == OP_OR ? t_or(ta, tb) : t_xor(ta, tb);
+      val[y[i]] = op == OP_XNOR ? t_not(r) : r;
+    }
+    break;
+  case OP_REDUCE_AND: {
+    Tern r = T1;
+    for(auto bit: a) r = t_and(r, val[bit]);
+    set_bits(val, y, r);
+    break;
+  }
+  case OP_REDUCE_OR: case OP_REDUCE_BOOL:
+    set_bits(val, y, reduce_or(val, a));
+    break;
+  case OP_REDUCE_XOR: {
+    Tern r = T0;
+    for(auto bit: a) r = t_xor(r, val[bit]);
+    set_bits(val, y, r);
+    break;
+  }
+  case OP_LOGIC_NOT:
+    set_bits(val, y, t_not(reduce_or(val, a)));
+    break;
+  case OP_LOGIC_AND:
+    set_bits(val, y, t_and(reduce_or(val, a), reduce_or(val, b)));
+    break;
+  case OP_LOGIC_OR:
+    set_bits(val, y, t_or(reduce_or(val, a), reduce_or(val, b)));
+    break;
+  case OP_EQ: case OP_NE: {
+    Tern r = T1;
+    for(size_t i = 0; i < std::max(a.size(), b.size()); i++)
+      r = t_and(r, t_not(t_xor(tern_bit(val, a, i), tern_bit(val, b, i))));
+    set_bits(val, y, op == OP_EQ ? r : t_not(r));
+    break;
+  }
+  case OP_MUX: {
+    Tern s = val[sm.cell_bits(cell, NAME_S)[0]];
+    for(size_t i = 0; i < width; i++) {
+      Tern ta = tern_bit(val, a, i), tb = tern_bit(val, b, i);
+      val[y[i]] = s == T0 ? ta : s == T1 ? tb : ta == tb ? ta : TX;
+    }
+    break;
+  }
+  case OP_PMUX: {
+    BitRange s = sm.cell_bits(cell, NAME_S);
+    int hot = -1, hits = 0;
+    bool known = true;
+    for(size_t j = 0; j < s.size(); j++) {
+      if(val[s[j]] == TX) known = false;
+      if(val[s[j]] == T1) {
+        hot = j;
+        hits++;
+      }
+    }
+    for(size_t i = 0; i < width; i++) {
+      Tern r = TX;
+      if(known && hits == 0) r = val[a[i]];
+      else if(known && hits == 1) r = val[b[hot * width + i]];
+      val[y[i]] = r;
+    }
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+
+std::vector<Tern> simulate(const NetSnapshot &snap, const SnapModule &sm, int input, uint32_t v,
+                           const std::vector<ModuleSummary> &summaries) {
+  std::vector<Tern> val = ternary_simulate(snap, sm, input, v, summaries);
+  std::vector<Tern> row;
+  for(size_t p = 0; p < sm.portWire.size(); p++)
+    if(sm.portDir[p] & PORT_OUT)
+      for(auto bit: sm.port_bits(p)) row.push_back(val[bit]);
+  return row;
+}
+
+
+/// summarize one module; children are already summarized
+ModuleSummary summarize(const NetSnapshot &snap, const SnapModule &sm,
+                        const std::vector<ModuleSummary> &summaries) {
+  ModuleSummary summary;
+  for(size_t p = 0; p < sm.portWire.size(); p++) {
+    int width = sm.wireWidth[sm.portWire[p]];
+    if(sm.portDir[p] != PORT_IN || width == 0 || width > SUMMARY_MAX_WIDTH) continue;
+    PortTransfer transfer;
+    transfer.input = p;
+    bool useful = false;
+    for(uint32_t v = 0; v < (1u << width); v++) {
+      transfer.table.push_back(simulate(snap, sm, p, v, summaries));
+      for(auto t: transfer.table.back())
+        if(t != TX) useful = true;
+    }
+    if(useful) summary.transfers.push_back(transfer);
+  }
+  return summary;
+}
+
+
+/// `module` at `path` and every instance below it; a summary depends on
+/// all of them
+void add_subtree(RTLIL::Module* module, const std::string &path, std::vector<Instance> &instances) {
+  instances.push_back(Instance{path, module});
+  for(auto cell: module->cells()) {
+    RTLIL::Module* subMod = module->design->module(cell->type);
+    if(subMod != nullptr) add_subtree(subMod, path + "." + cell->name.str(), instances);
+  }
+}
+
+PRIVATE_NAMESPACE_END
+
+
+/// Value of every bit of the module with one input port set to v and
+/// all other inputs unknown. Instances use the child summaries if any.
+std::vector<Tern> ternary_simulate(const NetSnapshot &snap, const SnapModule &sm, int port,
+                                   uint32_t v, const std::vector<ModuleSummary> &summaries) {
+  std::vector<Tern> val(sm.numBits, TX);
+  val[BIT_CONST0] = T0;
+  val[BIT_CONST1] = T1;
+  BitRange in = sm.port_bits(port);
+  for(size_t i = 0; i < in.size(); i++)
+    if(in[i] > BIT_CONSTX) val[in[i]] = (v >> i) & 1 ? T1 : T0;
+  for(auto cell: sm.order)
+    eval_cell(snap, sm, cell, val, summaries);
+  return val;
+}
+
+
+/// Summarize every module bottom-up. A module is handed to the thread
+/// pool as soon as all of its children are done.
+void build_summaries(const NetSnapshot &snap, int threads) {
+  int total = snap.modules.size();
+  g_summaries.assign(total, ModuleSummary());
+
+  std::vector<std::vector<int>> parents(total);
+  std::vector<int> pending(total, 0);
+  std::vector<int> ready;
+  for(int i = 0; i < total; i++) {
+    pending[i] = snap.modules[i].children.size();
+    for(auto child: snap.modules[i].children) parents[child].push_back(i);
+    if(pending[i] == 0) ready.push_back(i);
+  }
+
+  std::mutex mtx;
+  std::condition_variable cv;
+  int finished = 0;
+  // modules being summarized; once none are and none are ready, the
+  // rest can never become ready
+  int busy = 0;
+  auto worker = [&]() {
+    std::unique_lock<std::mutex> lock(mtx);
+    while(true) {
+      cv.wait(lock, [&]() { return !ready.empty() || busy == 0; });
+      if(ready.empty()) return;
+      int i = ready.back();
+      ready.pop_back();
+      busy++;
+      lock.unlock();
+      ModuleSummary summary = summarize(snap, snap.modules[i], g_summaries);
+      lock.lock();
+      g_summaries[i] = summary;
+      finished++;
+      busy--;
+      for(auto parent: parents[i])
+        if(--pending[parent] == 0) ready.push_back(parent);
+      cv.notify_all();
+    }
+  };
+  if(threads <= 0) threads = std::max(1u, std::thread::hardware_concurrency());
+  threads = std::min(threads, std::max(total, 1));
+  std::vector<std::thread> pool;
+  for(int t = 0; t < threads; t++) pool.emplace_back(worker);
+  for(auto &t: pool) t.join();
+  // modules on a recursive hierarchy never became ready
+  if(finished < total) {
+    std::string names;
+    for(int i = 0; i < total; i++)
+      if(pending[i] > 0)
+        names += stringf("%s%s", names.empty() ? "" : ", ", log_id(RTLIL::IdString(snap.modules[i].name)));
+    log_warning("opt_ctrd: %d modules left unsummarized: %s.\n", total - finished, names.c_str());
+  }
+
+  int transfers = 0;
+  for(auto &summary: g_summaries) transfers += summary.transfers.size();
+  log("Summarized %d modules on %d threads: %d port transfers.\n", total, threads, transfers);
+}
+
+
+const PortTransfer* find_transfer(RTLIL::Module* module, RTLIL::IdString port) {
+  int id = g_snapshot.module_id(module);
+  if(id < 0 || id >= (int)g_summaries.size()) return nullptr;
+  int portId = g_snapshot.port_id(id, port.str());
+  for(auto &transfer: g_summaries[id].transfers)
+    if(transfer.input == portId) return &transfer;
+  return nullptr;
+}
+
+
+/// output bits that are the same for every value in the set
+std::vector<Tern> transfer_outputs(const PortTransfer &transfer, const ValueSet_t &values) {
+  std::vector<Tern> out;
+  bool first = true;
+  for(uint32_t v = 0; v < values.size() && v < transfer.table.size(); v++) {
+    if(!values[v]) continue;
+    const std::vector<Tern> &row = transfer.table[v];
+    if(first) out = row;
+    else
+      for(size_t k = 0; k < out.size(); k++)
+        if(out[k] != row[k]) out[k] = TX;
+    first = false;
+  }
+  return out;
+}
+
+
+/// Use the child's summary at an instance: record constant outputs as
+/// port facts, add the transfer relation to the solver facts and pass
+/// value sets on to the wires the outputs drive.
+bool consult_summary(RTLIL::Cell* cell, RTLIL::Module* subMod, RTLIL::IdString port,
+                     RTLIL::SigSpec ctrdSig, const ValueSet_t &values) {
+  const PortTransfer* transfer = find_transfer(subMod, port);
+  if(transfer == nullptr || values.size() != transfer->table.size()) return false;
+  const SnapModule &sm = g_snapshot.modules[g_snapshot.module_id(subMod)];
+  std::vector<Tern> outs = transfer_outputs(*transfer, values);
+  std::string path = get_path();
+  std::vector<RTLIL::Cell*> inner = g_cell_stack;
+  inner.push_back(cell);
+  std::vector<Instance> about = {Instance{path, cell->module}};
+  add_subtree(subMod, get_path(inner), about);
+  size_t offset = 0;
+  for(size_t p = 0; p < sm.portWire.size(); p++) {
+    if(!(sm.portDir[p] & PORT_OUT)) continue;
+    RTLIL::IdString portName = sm.wireName[sm.portWire[p]];
+    size_t outWidth = sm.wireWidth[sm.portWire[p]];
+    size_t base = offset;
+    offset += outWidth;
+    if(!cell->hasPort(portName)) continue;
+    RTLIL::SigSpec sig = cell->getPort(portName);
+    if(!sig.is_chunk() || (size_t)sig.size() != outWidth) continue;
+
+    std::vector<RTLIL::State> bits;
+    for(size_t k = 0; k < outWidth; k++)
+      bits.push_back(outs[base + k] == T0 ? RTLIL::State::S0 :
+                     outs[base + k] == T1 ? RTLIL::State::S1 : RTLIL::State::Sx);
+    if(std::find(bits.begin(), bits.end(), RTLIL::State::Sx) == bits.end())
+      g_port_facts.push_back(PortFact{path, cell, portName, sig, RTLIL::Const(bits)});
+
+    ValueSet_t outValues(outWidth <= MAX_VALUE_SET_WIDTH ? 1 << outWidth : 0, false);
+    bool allKnown = true;
+    for(uint32_t v = 0; v < values.size(); v++) {
+      if(!values[v]) continue;
+      const std::vector<Tern> &row = transfer->table[v];
+      uint32_t outValue = 0;
+      bool known = true;
+      for(size_t k = 0; k < outWidth; k++) {
+        if(row[base + k] == TX) known = false;
+        if(row[base + k] == T1) outValue |= 1u << k;
+      }
+      if(!known) {
+        allKnown = false;
+        continue;
+      }
+      add_fact(Fact{FACT_IMPLIES, ctrdSig, path, sig, path, v, outValue, cell, about});
+      if(!outValues.empty()) outValues[outValue] = true;
+    }
+    if(allKnown && !outValues.empty())
+      g_value_sets[get_hier_name(sig)] = outValues;
+  }
+  return true;
+}
+
+
+/// tie instance outputs that are constant on every path of their parent
+int apply_port_facts() {
+  std::vector<std::pair<RTLIL::Cell*, RTLIL::IdString>> order;
+  std::map<std::pair<RTLIL::Cell*, RTLIL::IdString>, std::vector<const PortFact*>> byPort;
+  for(auto &fact: g_port_facts) {
+    auto key = std::make_pair(fact.cell, fact.port);
+    if(byPort.count(key) == 0) order.push_back(key);
+    byPort[key].push_back(&fact);
+  }
+  int tied = 0;
+  for(auto &key: order) {
+    auto &facts = byPort[key];
+    RTLIL::Module* parent = key.first->module;
+    if(!all_paths_visited(parent)) continue;
+    const std::set<std::string> &paths = g_visited_paths[parent];
+    std::set<std::string> agreeing;
+    for(auto fact: facts)
+      if(fact->value == facts.front()->value) agreeing.insert(fact->path);
+    if(agreeing != paths) continue;
+    g_edit_log.tie_port(key.first, key.second, facts.front()->sig, facts.front()->value);
+    tied++;
+  }
+  g_port_facts.clear();
+  return tied;
+}
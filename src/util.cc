@@ -1,9 +1,28 @@
 #include "ctrd_prop.h"
+#include "util.h"
+#include "facts.h"
 
+#ifdef CTRD_HAVE_Z3
 using namespace z3;
+#endif
 
 USING_YOSYS_NAMESPACE
-PRIVATE_NAMESPACE_BEGIN
+
+CtrdOptions g_options;
+PassBudget g_budget;
+std::queue<WorkItem> g_work_list;
+std::vector<RTLIL::Cell*> g_cell_stack;
+// g_cell_stack as get_path() names it, kept in step by enter_instance()
+// and leave_instance()
+static std::string g_cur_path;
+std::vector<CheckSet> g_check_vec;
+#ifdef CTRD_HAVE_Z3
+std::map<std::string, expr> g_expr_map;
+#endif
+dict<RTLIL::Module*, ModIndex> g_mod_index;
+dict<RTLIL::Module*, std::set<std::string>> g_instance_paths;
+dict<RTLIL::Module*, std::set<std::string>> g_visited_paths;
+std::map<std::string, ValueSet_t> g_value_sets;
 
 /// utils
 std::string toStr(int i) {
@@ -11,70 +30,212 @@ std::string toStr(int i) {
 }
 
 
-void print_cell(RTLIL::Cell* cell) {
-  std::cout << "cell name: " << cell->name.str() << std::endl;
-  std::cout << "cell type: " << cell->type.str() << std::endl;
+void print_module(RTLIL::Module *module) {
+  std::cout << "module: " << module->name.str() << std::endl;
+}
+
+
+bool complete_signal(RTLIL::SigSpec sig) {
+  return sig.is_chunk();
+}
+
+
+bool equal_width(RTLIL::SigSpec sig1, RTLIL::SigSpec sig2) {
+  return sig1.size() == sig2.size();
 }
 
-void print_sigspec(RTLIL::SigSpec connSig) {
-  if(connSig.is_wire()) {
-    auto wire = connSig.as_wire();
-    std::string wireName = wire->name.str();
-    if(wireName == "\\io_opcode") std::cout << "find io_opcode" << std::endl;
-    std::cout << "wire: " << wireName << std::endl;
+
+/// module index
+void ModIndex::build(RTLIL::Module* mod) {
+  module = mod;
+  wires.clear();
+  bitPorts.clear();
+  cellIds.clear();
+  cellList.clear();
+  kinds.clear();
+  for(auto pair: mod->wires_)
+    wires[pair.first] = pair.second;
+  liveBits.clear();
+  for(auto pair: mod->wires_)
+    if(pair.second->port_output)
+      add_live(RTLIL::SigSpec(pair.second));
+  for(auto &conn: mod->connections()) {
+    add_live(conn.first);
+    add_live(conn.second);
   }
-  else if(connSig.is_fully_const()) {
-    std::cout << "const: " << connSig.as_int() << std::endl;    
+  for(auto cellPair: mod->cells_)
+    add_cell(cellPair.second);
+}
+
+
+CellKind get_cell_kind(RTLIL::Cell* cell) {
+  RTLIL::IdString type = cell->type;
+  if(type == ID($eq)) return CK_EQ;
+  if(type == ID($ne)) return CK_NE;
+  if(type.in(ID($lt), ID($le), ID($gt), ID($ge))) return CK_LT;
+  if(type == ID($and)) return CK_AND;
+  RTLIL::Design* design = cell->module->design;
+  if(!type.begins_with("$") && design != nullptr && design->module(type) != nullptr)
+    return CK_SUBMOD;
+  return CK_OTHER;
+}
+
+
+void ModIndex::add_cell(RTLIL::Cell* cell) {
+  int id = cellList.size();
+  cellIds[cell] = id;
+  cellList.push_back(cell);
+  kinds.push_back(get_cell_kind(cell));
+  for(auto &conn: cell->connections_) {
+    int offset = 0;
+    for(auto bit: conn.second) {
+      if(bit.wire != nullptr)
+        bitPorts[bit].push_back(PortRef{cell, conn.first, offset, id});
+      offset++;
+    }
   }
 }
 
-void print_IdString(RTLIL::IdString id) {
-  std::cout << "IdString: " << id.str() << std::endl;
+
+void ModIndex::remove_cell(RTLIL::Cell* cell) {
+  auto it = cellIds.find(cell);
+  if(it != cellIds.end()) {
+    // ids stay dense and stable; the slot is left empty
+    cellList[it->second] = nullptr;
+    kinds[it->second] = CK_OTHER;
+    cellIds.erase(it);
+  }
+  for(auto &conn: cell->connections_) {
+    for(auto bit: conn.second) {
+      auto it = bitPorts.find(bit);
+      if(it == bitPorts.end()) continue;
+      auto &refs = it->second;
+      refs.erase(std::remove_if(refs.begin(), refs.end(),
+                                [cell](const PortRef &ref) { return ref.cell == cell; }),
+                 refs.end());
+      if(refs.empty()) bitPorts.erase(it);
+    }
+  }
 }
 
-void print_module(RTLIL::Module *module) {
-  std::cout << "module: " << module->name.str() << std::endl;
+
+void ModIndex::add_live(RTLIL::SigSpec sig) {
+  for(auto bit: sig)
+    if(bit.wire != nullptr) liveBits.insert(bit);
 }
 
 
-bool cell_is_module(Design* design, RTLIL::Cell* cell) {
-  RTLIL::IdString type = cell->type;
-  std::string typeName = type.str();
-  if(typeName.front() != '$' && design->modules_.find(type) != design->modules_.end())
-    return true;
-  else return false;
+RTLIL::Wire* ModIndex::wire(const std::string &name) const {
+  auto it = wires.find(RTLIL::IdString(name));
+  if(it == wires.end()) return nullptr;
+  return it->second;
 }
 
 
-bool cell_is_bitAnd(Design* design, RTLIL::Cell* cell) {
-  RTLIL::IdString type = cell->type;
-  std::string typeName = type.str();
-  if(typeName.front() != '$' && design->modules_.find(type) != design->modules_.end())
-    return true;
-  else return false;
+const std::vector<PortRef>& ModIndex::ports(RTLIL::SigBit bit) const {
+  static const std::vector<PortRef> empty;
+  auto it = bitPorts.find(bit);
+  if(it == bitPorts.end()) return empty;
+  return it->second;
 }
 
-bool complete_signal(RTLIL::SigSpec sig) {
-  return !sig.is_chunk() && !sig.is_bit();
+
+std::set<RTLIL::Cell*> ModIndex::cells(RTLIL::SigSpec sig) const {
+  std::set<RTLIL::Cell*> ret;
+  for(auto bit: sig)
+    for(auto &ref: ports(bit))
+      ret.insert(ref.cell);
+  return ret;
 }
 
 
-bool equal_width(RTLIL::SigSpec sig1, RTLIL::SigSpec sig2) {
-  return sig1.size() == sig2.size();
+std::set<RTLIL::Cell*> ModIndex::drivers(RTLIL::SigSpec sig) const {
+  std::set<RTLIL::Cell*> ret;
+  for(auto bit: sig)
+    for(auto &ref: ports(bit))
+      if(ref.cell->output(ref.port)) ret.insert(ref.cell);
+  return ret;
+}
+
+
+/// dense ids of the cells connected to `sig`, each once, in id order
+std::vector<int> ModIndex::cell_ids(RTLIL::SigSpec sig) const {
+  std::vector<int> ids;
+  for(auto bit: sig)
+    for(auto &ref: ports(bit))
+      ids.push_back(ref.id);
+  std::sort(ids.begin(), ids.end());
+  ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+  return ids;
 }
 
 
-RTLIL::SigSpec get_cell_port(RTLIL::SigSpec sig, RTLIL::Cell *cell) {
-  for(auto pair : cell->connections_) {
-    auto portId = pair.first;
-    auto connSig = pair.second;
-    // only consider one case here:
-    // 1. port and sig are perfectly connected
-    assert(complete_signal(connSig));
-    assert(complete_signal(sig));
-    if(connSig == sig) return cell->getPort(portId);
+bool ModIndex::is_read(RTLIL::SigBit bit) const {
+  if(liveBits.count(bit)) return true;
+  for(auto &ref: ports(bit))
+    if(ref.cell->input(ref.port)) return true;
+  return false;
+}
+
+
+ModIndex& get_mod_index(RTLIL::Module* module) {
+  auto it = g_mod_index.find(module);
+  if(it != g_mod_index.end()) return it->second;
+  ModIndex &idx = g_mod_index[module];
+  idx.build(module);
+  return idx;
+}
+
+
+void invalidate_mod_index(RTLIL::Module* module) {
+  g_mod_index.erase(module);
+}
+
+
+RTLIL::IdString get_cell_port(const ModIndex &idx, RTLIL::SigSpec sig, RTLIL::Cell *cell) {
+  // only consider one case here:
+  // 1. port and sig are perfectly connected
+  assert(complete_signal(sig));
+  if(sig.empty()) return RTLIL::IdString();
+  for(auto &ref: idx.ports(sig[0])) {
+    if(ref.cell != cell || ref.offset != 0) continue;
+    if(cell->getPort(ref.port) == sig) return ref.port;
   }
-  return RTLIL::SigSpec();
+  return RTLIL::IdString();
+}
+
+
+PRIVATE_NAMESPACE_BEGIN
+
+void add_instance_paths(RTLIL::Module* module, std::vector<RTLIL::Cell*> &stack) {
+  g_instance_paths[module].insert(get_path(stack));
+  for(auto cell: module->cells()) {
+    RTLIL::Module* subMod = module->design->module(cell->type);
+    if(subMod == nullptr) continue;
+    stack.push_back(cell);
+    add_instance_paths(subMod, stack);
+    stack.pop_back();
+  }
+}
+
+PRIVATE_NAMESPACE_END
+
+
+/// every instance path of every module below `top`, named like get_path()
+void enumerate_instance_paths(RTLIL::Module* top) {
+  g_instance_paths.clear();
+  std::vector<RTLIL::Cell*> stack;
+  add_instance_paths(top, stack);
+}
+
+
+/// True if propagation reached `module` on every path it is instantiated
+/// on. Only then may a rewrite inside the module rely on what was proven.
+bool all_paths_visited(RTLIL::Module* module) {
+  auto visited = g_visited_paths.find(module);
+  auto all = g_instance_paths.find(module);
+  if(visited == g_visited_paths.end() || all == g_instance_paths.end()) return false;
+  return visited->second == all->second;
 }
 
 
@@ -83,19 +244,45 @@ RTLIL::Module* get_subModule(Design* design, RTLIL::Cell* cell) {
 }
 
 
-RTLIL::SigSpec get_sigspec(RTLIL::Module* module, 
+RTLIL::SigSpec get_sigspec(const ModIndex &idx, 
                            std::string inputName, int offset, int length) {
-  for(auto pair: module->wires_) {
-    auto id = pair.first;
-    auto wire = pair.second;
-    if(wire->name.str() == inputName) {
-      return RTLIL::SigSpec(wire, offset, length);
-    }
-  }
+  RTLIL::Wire* wire = idx.wire(inputName);
+  if(wire == nullptr || offset < 0 || length < 0 || offset + length > wire->width) return RTLIL::SigSpec();
+  return RTLIL::SigSpec(wire, offset, length);
 }
 
 
-std::string get_path(const std::vector<RTLIL::Cell*> &cell_stack = g_cell_stack) {
+RTLIL::SigSpec get_port_sigspec(const ModIndex &idx, RTLIL::IdString port) {
+  RTLIL::Wire* wire = idx.wire(port.str());
+  if(wire == nullptr) return RTLIL::SigSpec();
+  return RTLIL::SigSpec(wire);
+}
+
+
+/// Step into the instance `cell` of the current module.
+void enter_instance(RTLIL::Cell* cell) {
+  if(!g_cell_stack.empty()) g_cur_path += ".";
+  g_cur_path += cell->name.str();
+  g_cell_stack.push_back(cell);
+}
+
+
+void leave_instance() {
+  assert(!g_cell_stack.empty());
+  size_t length = g_cell_stack.back()->name.size();
+  g_cell_stack.pop_back();
+  if(!g_cell_stack.empty()) length++;
+  g_cur_path.resize(g_cur_path.size() - length);
+}
+
+
+/// path of the instance being walked, without building it again
+const std::string &get_path() {
+  return g_cur_path;
+}
+
+
+std::string get_path(const std::vector<RTLIL::Cell*> &cell_stack) {
   std::string path;
   bool first = true;
   for(auto cell: cell_stack) {
@@ -112,10 +299,14 @@ std::string get_path(const std::vector<RTLIL::Cell*> &cell_stack = g_cell_stack)
 
 
 std::string get_hier_name(RTLIL::SigSpec inputSig) {
-  assert(!inputSig.is_bit());
-  std::string path = get_path();
+  return get_hier_name(inputSig, get_path());
+}
+
+
+std::string get_hier_name(RTLIL::SigSpec inputSig, const std::string &path) {
+  assert(inputSig.is_chunk());
   std::string wireName;
-  wireName = inputSig.as_wire()->name.str();
+  wireName = inputSig.as_chunk().wire->name.str();
   return path + "." + wireName;
 }
 
@@ -127,18 +318,16 @@ bool get_bit(uint32_t value, uint32_t pos) {
 }
 
 
-void add_neq_ctrd(solver &s, context &c, RTLIL::SigSpec inputSig, int forbidValue) {
+void add_neq_ctrd(RTLIL::Module* module, RTLIL::SigSpec inputSig, int forbidValue) {
   assert(complete_signal(inputSig));
   std::string inputName = get_hier_name(inputSig);
   int width = inputSig.size();
-  //if(g_expr_map.find(inputName) != g_expr_map.end()) {
-  //  expr inputExpr = g_expr_map[inputName];
-  //  s.add(inputExpr != forbidValue);
-  //}
-  //else {
-    expr inputExpr = c.bv_const(inputName.c_str(), width);
-    s.add(inputExpr != forbidValue);
-  //}
+  add_fact(Fact{FACT_NE_CONST, inputSig, get_path(), RTLIL::SigSpec(), "", (uint32_t)forbidValue, 0, nullptr, {{get_path(), module}}});
+  if(width <= MAX_VALUE_SET_WIDTH) {
+    ValueSet_t values(1 << width, true);
+    if(forbidValue >= 0 && forbidValue < (1 << width)) values[forbidValue] = false;
+    g_value_sets[inputName] = values;
+  }
 }
 
 
@@ -164,56 +353,89 @@ void add_neq_ctrd(solver &s, context &c, RTLIL::SigSpec inputSig, int forbidValu
 //}
 
 
-expr get_expr(context &c, RTLIL::SigSpec sig, std::string path) {
+#ifdef CTRD_HAVE_Z3
+/// the variable of `sig` on instance `path`, taken literally
+expr wire_expr(context &c, RTLIL::SigSpec sig, const std::string &path) {
   int width = sig.size();
-  std::string name;
-  if(path.empty()) name = get_hier_name(sig);  
-  else name = sig.as_wire()->name.str();
+  std::string name = get_hier_name(sig, path);
   if(sig.is_wire()) {
-    if(g_expr_map.find(name) != g_expr_map.end())
-      return *g_expr_map[name];
+    auto it = g_expr_map.find(name);
+    if(it != g_expr_map.end())
+      return it->second;
     else {
       expr ret = width > 1 ? c.bv_const(name.c_str(), width) : c.bool_const(name.c_str());
-      g_expr_map.emplace(name, &ret);
+      g_expr_map.emplace(name, ret);
       return ret;
     }
   }
-  else if(sig.is_chunk()) {
+  else {
+    assert(sig.is_chunk());
     auto chunk = sig.as_chunk();
     int offset = chunk.offset;
-    if(g_expr_map.find(name) != g_expr_map.end()) {
-      expr* completeExpr = g_expr_map[name];
-      return completeExpr->extract(width+offset-1, offset);
+    auto it = g_expr_map.find(name);
+    if(it != g_expr_map.end()) {
+      return it->second.extract(width+offset-1, offset);
     }
     else {
-      int fullWidth = sig.size();
-      expr ret = width > 1 ? c.bv_const(name.c_str(), fullWidth) : c.bool_const(name.c_str());
-      g_expr_map.emplace(name, &ret);
+      int fullWidth = chunk.wire->width;
+      expr ret = c.bv_const(name.c_str(), fullWidth);
+      g_expr_map.emplace(name, ret);
       return ret.extract(width+offset-1, offset);
     }
   }
 }
 
 
-void traverse(Design* design, RTLIL::Module* module) {
-  std::cout << "=== Begin a new module:"  << std::endl;
-  print_module(module);
-  // traverse all cells
-  for(auto cellPair : module->cells_) {
-    RTLIL::IdString IdStr = cellPair.first;
-    RTLIL::Cell* cell = cellPair.second;
-    print_module(cell->module);
-    print_cell(cell);
-    bool use_ctrd_sig = false;
-    bool use_forbid_value = false;
-    RTLIL::SigSpec outputWire;
-    RTLIL::IdString outputPort;
-    for(auto &conn: cell->connections_) {
-      RTLIL::IdString port = conn.first;
-      RTLIL::SigSpec connSig = conn.second;
-      print_sigspec(connSig);
-    }
-  }
+/// the variable of `sig` on `path`, or on the current instance if empty
+expr get_expr(context &c, RTLIL::SigSpec sig, std::string path) {
+  return wire_expr(c, sig, path.empty() ? get_path() : path);
 }
 
-PRIVATE_NAMESPACE_END
+
+expr as_bool(context &c, const expr &e) {
+  if(e.is_bool()) return e;
+  return e == c.bv_val(1, 1);
+}
+#endif
+
+
+void PassBudget::begin(double limit) {
+  start = std::chrono::steady_clock::now();
+  seconds = limit;
+}
+
+
+bool PassBudget::exhausted() const {
+  if(seconds <= 0) return false;
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() >= seconds;
+}
+
+
+unsigned PassBudget::remaining_ms() const {
+  if(seconds <= 0) return 0;
+  double left = seconds - std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return std::max(1.0, left * 1000);
+}
+
+
+/// the per-query timeout capped by what is left of the budget, 0 if none
+unsigned query_timeout() {
+  unsigned timeout = g_options.timeout;
+  unsigned left = g_budget.remaining_ms();
+  if(left > 0 && (timeout == 0 || left < timeout)) timeout = left;
+  return timeout;
+}
+
+
+#ifdef CTRD_HAVE_Z3
+/// Bound the next check of `s` by the per-query limits and what is left
+/// of the pass budget. A check that hits a limit answers unknown.
+void limit_query(solver &s) {
+  unsigned timeout = query_timeout();
+  if(timeout == 0 && g_options.rlimit == 0) return;
+  params p(s.ctx());
+  if(timeout > 0) p.set("timeout", timeout);
+  if(g_options.rlimit > 0) p.set("rlimit", g_options.rlimit);
+  s.set(p);
+}
+#endif
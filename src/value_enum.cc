@@ -0,0 +1,113 @@
+#include "ctrd_prop.h"
+#include "util.h"
+#include "value_enum.h"
+
+#ifdef CTRD_HAVE_Z3
+using namespace z3;
+#endif
+
+USING_YOSYS_NAMESPACE
+
+
+void EnumStats::log_summary() const {
+  if(signals == 0 && aborted == 0) return;
+  log("Enumerated %d signals (%d values in %d checks, %d given up): %d candidates answered by lookup.\n",
+      signals, values, checks, aborted, answered);
+}
+
+
+bool is_ordered_compare(RTLIL::Cell* cell) {
+  return cell->type.in(ID($lt), ID($le), ID($gt), ID($ge));
+}
+
+
+/// output of a comparator when the constrained signal is `value`
+int compare_output(RTLIL::Cell* cell, RTLIL::SigSpec ctrdSig, uint32_t value, uint32_t constant) {
+  // the constrained signal may sit on either side
+  bool ctrdIsA = cell->getPort(ID::A) == ctrdSig;
+  uint32_t a = ctrdIsA ? value : constant;
+  uint32_t b = ctrdIsA ? constant : value;
+  if(cell->type == ID($eq)) return a == b;
+  if(cell->type == ID($ne)) return a != b;
+  if(cell->type == ID($lt)) return a < b;
+  if(cell->type == ID($le)) return a <= b;
+  if(cell->type == ID($gt)) return a > b;
+  return a >= b;
+}
+
+
+/// the output shared by all values, or -1
+int lookup_verdict(const CheckSet &set, const std::vector<uint32_t> &values) {
+  RTLIL::Cell* cell = set.cell;
+  for(auto param: {ID::A_SIGNED, ID::B_SIGNED})
+    if(cell->hasParam(param) && cell->getParam(param).as_bool()) return -1;
+  int verdict = -1;
+  for(auto v: values) {
+    int out = compare_output(cell, set.ctrdSig, v, set.forbidValue);
+    if(verdict >= 0 && out != verdict) return -1;
+    verdict = out;
+  }
+  return verdict;
+}
+
+
+/// Whether the solvers model the comparator's relation. Relations are
+/// compared at 32 bits so that constants wider than the signal behave;
+/// signed compares are not modelled.
+bool compare_modelled(RTLIL::Cell* cell, RTLIL::SigSpec ctrdSig) {
+  for(auto param: {ID::A_SIGNED, ID::B_SIGNED})
+    if(cell->hasParam(param) && cell->getParam(param).as_bool()) return false;
+  return ctrdSig.size() <= 32 && cell->type.in(ID($eq), ID($ne), ID($lt), ID($le), ID($gt), ID($ge));
+}
+
+
+#ifdef CTRD_HAVE_Z3
+/// the comparator's relation over the constrained signal
+bool compare_expr(context &c, RTLIL::Cell* cell, RTLIL::SigSpec ctrdSig,
+                  const expr &ctrdExpr, uint32_t constant, expr &result) {
+  if(!compare_modelled(cell, ctrdSig)) return false;
+  int width = ctrdSig.size();
+  expr value = ctrdExpr.is_bool() ? ite(ctrdExpr, c.bv_val(1, 32), c.bv_val(0, 32))
+             : width < 32 ? zext(ctrdExpr, 32 - width) : ctrdExpr;
+  expr k = c.bv_val(constant, 32);
+  bool ctrdIsA = cell->getPort(ID::A) == ctrdSig;
+  expr a = ctrdIsA ? value : k;
+  expr b = ctrdIsA ? k : value;
+  if(cell->type == ID($eq)) result = a == b;
+  else if(cell->type == ID($ne)) result = a != b;
+  else if(cell->type == ID($lt)) result = ult(a, b);
+  else if(cell->type == ID($le)) result = ule(a, b);
+  else if(cell->type == ID($gt)) result = ugt(a, b);
+  else if(cell->type == ID($ge)) result = uge(a, b);
+  else return false;
+  return true;
+}
+
+
+/// Collect every value the signal can take under the current assertions,
+/// blocking each one as it is found. Gives up after `limit` values or
+/// on an unknown answer. Every solver call is added to `checks`.
+bool enumerate_values(solver &s, const expr &sigExpr, int width, size_t limit,
+                      std::vector<uint32_t> &values, int &checks) {
+  values.clear();
+  s.push();
+  bool complete = false;
+  while(values.size() <= limit) {
+    limit_query(s);
+    checks++;
+    check_result result = s.check();
+    if(result == unsat) {
+      complete = true;
+      break;
+    }
+    if(result != sat) break;
+    expr value = s.get_model().eval(sigExpr, true);
+    uint32_t v = value.is_bool() ? value.is_true() : value.get_numeral_uint();
+    values.push_back(v);
+    if(value.is_bool()) s.add(sigExpr != value);
+    else s.add(sigExpr != s.ctx().bv_val(v, width));
+  }
+  s.pop();
+  return complete;
+}
+#endif
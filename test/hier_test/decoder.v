@@ -0,0 +1,34 @@
+// a case table: comparators on one input select constant outputs
+module case_table(
+  input      [7:0]  opcode ,
+  output reg [3:0]  code
+);
+
+  always @* begin
+    case(opcode)
+      8'h1: code = 4'h3;
+      8'h2: code = 4'h5;
+      default: code = 4'h5;
+    endcase
+  end
+endmodule
+
+module test(
+  input         clock,
+  input         reset,
+  input  [15:0] io_x,
+  input  [15:0] io_y,
+  input  [7:0]  io_opcode,
+  output [15:0] io_result,
+  output [1:0]  io_flags
+);
+  wire [3:0] _code ;
+
+  case_table t0 (
+   .opcode    (io_opcode),
+   .code      (_code)
+  );
+
+  assign io_result = {io_x[15:4], _code};
+  assign io_flags = _code[1:0];
+endmodule
@@ -0,0 +1,38 @@
+// Holds the gold and gate copies of the top module side by side and
+// asserts that they agree whenever the constraint of opt_ctrd holds.
+module equiv(
+  input         clock,
+  input         reset,
+  input  [15:0] io_x,
+  input  [15:0] io_y,
+  input  [7:0]  io_opcode
+);
+  wire [15:0] gold_result, gate_result;
+  wire [1:0]  gold_flags, gate_flags;
+
+  gold u_gold (
+   .clock     (clock),
+   .reset     (reset),
+   .io_x      (io_x),
+   .io_y      (io_y),
+   .io_opcode (io_opcode),
+   .io_result (gold_result),
+   .io_flags  (gold_flags)
+  );
+
+  gate u_gate (
+   .clock     (clock),
+   .reset     (reset),
+   .io_x      (io_x),
+   .io_y      (io_y),
+   .io_opcode (io_opcode),
+   .io_result (gate_result),
+   .io_flags  (gate_flags)
+  );
+
+  always @* begin
+    assume(io_opcode != 8'h1);
+    assert(gold_result == gate_result);
+    assert(gold_flags == gate_flags);
+  end
+endmodule
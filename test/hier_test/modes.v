@@ -0,0 +1,66 @@
+module decode(
+  input  [7:0]  opcode ,
+  output        is_add ,
+  output        is_and ,
+  output        is_or  ,
+  output        is_low ,
+  output        is_zero
+);
+
+  wire [7:0] m = opcode & 8'h0e;
+
+  assign is_add  = opcode == 8'h1;
+  assign is_and  = opcode == 8'h2;
+  assign is_or   = opcode == 8'h3;
+  assign is_low  = opcode < 8'h2;
+  assign is_zero = m == 8'h0;
+endmodule
+
+module test(
+  input         clock,
+  input         reset,
+  input  [15:0] io_x,
+  input  [15:0] io_y,
+  input  [7:0]  io_opcode,
+  output [15:0] io_result,
+  output [1:0]  io_flags
+);
+  wire  _T ;
+  wire  _T_3 ;
+  wire  _T_5 ;
+  wire  _low ;
+  wire  _zero ;
+  wire  _add_1 ;
+  wire  _unused_and ;
+  wire  _unused_or ;
+  wire  _unused_low ;
+  wire  _zero_1 ;
+  wire [15:0] _T_2 = io_x + io_y;
+  wire [15:0] _T_4 = io_x & io_y;
+
+  decode u0 (
+   .opcode    (io_opcode),
+   .is_add    (_T),
+   .is_and    (_T_3),
+   .is_or     (_T_5),
+   .is_low    (_low),
+   .is_zero   (_zero)
+  );
+
+  // a second instance, so that the same wires sit on two paths
+  decode u1 (
+   .opcode    (io_opcode),
+   .is_add    (_add_1),
+   .is_and    (_unused_and),
+   .is_or     (_unused_or),
+   .is_low    (_unused_low),
+   .is_zero   (_zero_1)
+  );
+
+  wire [15:0] _T_6 = io_x | io_y;
+  wire [15:0] _T_8 = io_x - io_y;
+  wire [15:0] _GEN_0 = _T_5 ? _T_6 : _T_8;
+  wire [15:0] _GEN_1 = _T_3 ? _T_4 : _GEN_0;
+  assign io_result = _T ? _T_2 : _GEN_1;
+  assign io_flags = {_low ^ _add_1, _zero & ~_zero_1};
+endmodule
@@ -0,0 +1,43 @@
+module cmp2(
+  input  [7:0]  a ,
+  input  [7:0]  b ,
+  output        a_one ,
+  output        b_one
+);
+
+  assign a_one = a == 8'h1;
+  assign b_one = b == 8'h1;
+endmodule
+
+module test(
+  input         clock,
+  input         reset,
+  input  [15:0] io_x,
+  input  [15:0] io_y,
+  input  [7:0]  io_opcode,
+  output [15:0] io_result,
+  output [1:0]  io_flags
+);
+  wire  _a0 ;
+  wire  _b0 ;
+  wire  _a1 ;
+  wire  _b1 ;
+
+  // the constrained opcode enters c0 on a and c1 on b
+  cmp2 c0 (
+   .a         (io_opcode),
+   .b         (io_y[7:0]),
+   .a_one     (_a0),
+   .b_one     (_b0)
+  );
+
+  cmp2 c1 (
+   .a         (io_y[7:0]),
+   .b         (io_opcode),
+   .a_one     (_a1),
+   .b_one     (_b1)
+  );
+
+  assign io_result = _a1 ? io_x : io_y;
+  assign io_flags = {_a0 | _b0, _b1};
+endmodule
@@ -0,0 +1,35 @@
+module decode(
+  input  [7:0]  opcode ,
+  output        is_x
+);
+
+  wire [7:0] m = opcode & 8'h0e;
+
+  assign is_x = m == 8'h0;
+endmodule
+
+module test(
+  input         clock,
+  input         reset,
+  input  [15:0] io_x,
+  input  [15:0] io_y,
+  input  [7:0]  io_opcode,
+  output [15:0] io_result,
+  output [1:0]  io_flags
+);
+  wire  _x0 ;
+  wire  _x1 ;
+
+  decode u0 (
+   .opcode    (io_opcode),
+   .is_x      (_x0)
+  );
+
+  decode u1 (
+   .opcode    (io_opcode),
+   .is_x      (_x1)
+  );
+
+  assign io_result = _x1 ? io_x : io_y;
+  assign io_flags = {_x0, _x1};
+endmodule
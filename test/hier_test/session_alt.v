@@ -0,0 +1,11 @@
+// Same wires as decode, other logic. check_session_swap.ys puts it on
+// the path of one decode instance between two runs.
+module alt_decode(
+  input  [7:0]  opcode ,
+  output        is_x
+);
+
+  wire [7:0] m = opcode & 8'hf0;
+
+  assign is_x = m == 8'h0;
+endmodule
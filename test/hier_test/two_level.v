@@ -0,0 +1,53 @@
+module decode(
+  input  [7:0]  opcode ,
+  output        is_add ,
+  output        is_and
+);
+
+  assign is_add = opcode == 8'h1;
+  assign is_and = opcode == 8'h2;
+endmodule
+
+// instantiated twice, but only m0 sees the constrained opcode
+module mid(
+  input  [7:0]  opcode ,
+  output        is_add ,
+  output        is_and
+);
+
+  decode d (
+   .opcode    (opcode),
+   .is_add    (is_add),
+   .is_and    (is_and)
+  );
+endmodule
+
+module test(
+  input         clock,
+  input         reset,
+  input  [15:0] io_x,
+  input  [15:0] io_y,
+  input  [7:0]  io_opcode,
+  output [15:0] io_result,
+  output [1:0]  io_flags
+);
+  wire  _add_0 ;
+  wire  _and_0 ;
+  wire  _add_1 ;
+  wire  _and_1 ;
+
+  mid m0 (
+   .opcode    (io_opcode),
+   .is_add    (_add_0),
+   .is_and    (_and_0)
+  );
+
+  mid m1 (
+   .opcode    (io_y[7:0]),
+   .is_add    (_add_1),
+   .is_and    (_and_1)
+  );
+
+  assign io_result = _add_1 ? io_x : _and_0 ? io_y : 16'h0;
+  assign io_flags = {_add_0, _add_1};
+endmodule